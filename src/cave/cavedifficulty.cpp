@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+
+#include "cave/caveset.hpp"
+#include "cave/caverendered.hpp"
+#include "cave/cavesolver.hpp"
+#include "cave/enginebench.hpp"
+#include "cave/elementproperties.hpp"
+#include "misc/logger.hpp"
+#include "misc/parallel.hpp"
+#include "misc/printf.hpp"
+#include "misc/util.hpp"
+
+#include "cave/cavedifficulty.hpp"
+
+
+/// Playthroughs are stopped after this number of frames, if the cave has
+/// no time limit or the player is still alive for some other reason.
+enum { GD_DIFFICULTY_MAX_FRAMES = 20000 };
+
+
+char const *gd_play_policy_name(GdPlayPolicy policy) {
+    switch (policy) {
+        case GD_PLAY_RANDOM:
+            return "random";
+        case GD_PLAY_GREEDY:
+            return "greedy";
+    }
+    return "unknown";
+}
+
+
+bool gd_play_policy_from_string(const char *str, GdPlayPolicy &policy) {
+    if (g_str_equal(str, "random"))
+        policy = GD_PLAY_RANDOM;
+    else if (g_str_equal(str, "greedy"))
+        policy = GD_PLAY_GREEDY;
+    else
+        return false;
+    return true;
+}
+
+
+char const *gd_play_outcome_name(GdPlayOutcome outcome) {
+    switch (outcome) {
+        case GD_OUTCOME_EXITED:
+            return "exited";
+        case GD_OUTCOME_TIMEOUT:
+            return "timeout";
+        case GD_OUTCOME_CRUSHED:
+            return "crushed";
+        case GD_OUTCOME_CREATURE:
+            return "creature";
+        case GD_OUTCOME_EXPLOSION:
+            return "explosion";
+        case GD_OUTCOME_VOODOO:
+            return "voodoo";
+        case GD_OUTCOME_OTHER_DEATH:
+            return "other";
+        case GD_OUTCOME_UNFINISHED:
+            return "unfinished";
+        case GD_OUTCOME_MAX:
+            break;
+    }
+    return "unknown";
+}
+
+
+/// Percentile p (between 0 and 1) of the values, by the nearest rank method.
+/// @return The percentile, or 0 if there are no values.
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    size_t rank = size_t(std::max(0.0, std::ceil(p * values.size()) - 1));
+    return values[std::min(rank, values.size() - 1)];
+}
+
+
+/// Percentage of the playthroughs which ended with the given outcome.
+double DifficultyLevel::percent(GdPlayOutcome outcome) const {
+    if (runs.empty())
+        return 0;
+    int count = 0;
+    for (auto const &run : runs)
+        if (run.outcome == outcome)
+            count++;
+    return 100.0 * count / runs.size();
+}
+
+
+/// Percentage of the playthroughs in which the player died, for any cause.
+double DifficultyLevel::percent_died() const {
+    double sum = 0;
+    for (int o = GD_OUTCOME_CRUSHED; o <= GD_OUTCOME_OTHER_DEATH; ++o)
+        sum += percent(GdPlayOutcome(o));
+    return sum;
+}
+
+
+/// Percentile of the time the player survived, in seconds.
+double DifficultyLevel::seconds_percentile(double p) const {
+    std::vector<double> values;
+    for (auto const &run : runs)
+        values.push_back(run.seconds);
+    return percentile(values, p);
+}
+
+
+/// Percentile of the diamonds collected.
+double DifficultyLevel::diamonds_percentile(double p) const {
+    std::vector<double> values;
+    for (auto const &run : runs)
+        values.push_back(run.diamonds);
+    return percentile(values, p);
+}
+
+
+/// Percentile of the time remaining, of the playthroughs in which the player exited.
+double DifficultyLevel::time_left_percentile(double p) const {
+    std::vector<double> values;
+    for (auto const &run : runs)
+        if (run.outcome == GD_OUTCOME_EXITED)
+            values.push_back(run.time_left);
+    return percentile(values, p);
+}
+
+
+static bool is_falling(GdElementEnum e) {
+    switch (e) {
+        case O_STONE_F:
+        case O_MEGA_STONE_F:
+        case O_DIAMOND_F:
+        case O_NUT_F:
+        case O_FALLING_WALL_F:
+        case O_FLYING_STONE_F:
+        case O_FLYING_DIAMOND_F:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+static bool is_creature(GdElementEnum e) {
+    return e >= O_GHOST && e <= O_DRAGONFLY_4_scanned;
+}
+
+
+static bool is_explosion(GdElementEnum e) {
+    return e >= O_PRE_DIA_0 && e <= O_AMOEBA_2_EXPL_4;
+}
+
+
+/// The surroundings of the player in the last frame the player was seen,
+/// to guess what killed them.
+struct PlayerSurroundings {
+    GdElementEnum cells[3][3];  ///< [dy+1][dx+1]
+    GdDirectionEnum gravity = MV_DOWN;
+
+    void remember(CaveRendered const &cave) {
+        for (int dy = -1; dy <= 1; ++dy)
+            for (int dx = -1; dx <= 1; ++dx)
+                cells[dy + 1][dx + 1] = nonscanned_pair(cave.map(cave.player_x + dx, cave.player_y + dy));
+        gravity = cave.gravity;
+    }
+
+    GdPlayOutcome cause_of_death() const {
+        /* something falling in the direction of gravity, just above the player */
+        if (is_falling(cells[1 - gd_dy[gravity]][1 - gd_dx[gravity]]))
+            return GD_OUTCOME_CRUSHED;
+        /* creatures kill the player by touching them */
+        if (is_creature(cells[0][1]) || is_creature(cells[1][0]) || is_creature(cells[1][2]) || is_creature(cells[2][1]))
+            return GD_OUTCOME_CREATURE;
+        for (int y = 0; y < 3; ++y)
+            for (int x = 0; x < 3; ++x)
+                if (is_explosion(cells[y][x]))
+                    return GD_OUTCOME_EXPLOSION;
+        return GD_OUTCOME_OTHER_DEATH;
+    }
+};
+
+
+/// Play a cave once, without drawing anything, and see how the player fares.
+/// @param cave The cave to play.
+/// @param level The level to play, 0 is level 1.
+/// @param seed The seed to render the cave with. Also seeds the movements of the player.
+/// @param policy How the player moves.
+/// @param max_frames Stop playing after this number of frames.
+Playthrough gd_difficulty_play(CaveStored const &cave, int level, int seed, GdPlayPolicy policy, int max_frames) {
+    CaveRendered rendered(cave, level, seed);
+    rendered.setup_for_game();
+    /* nothing is drawn, so the cave can be scanned with the faster scheduler */
+    rendered.active_cell_scan = true;
+    ScriptedInput random_input(seed);
+    RandomGenerator random(seed);
+
+    Playthrough run;
+    run.seed = seed;
+    PlayerSurroundings surroundings;
+    bool seen_once = false;
+    /* the player is declared dead some frames after disappearing; the
+     * cause is guessed when they disappear */
+    GdPlayOutcome vanished = GD_OUTCOME_UNFINISHED;
+    for (int frame = 0; frame < max_frames; ++frame) {
+        if (rendered.player_state == GD_PL_LIVING && rendered.player_seen_ago == 0) {
+            surroundings.remember(rendered);
+            seen_once = true;
+            run.frames = frame;
+            run.seconds = double(rendered.time_elapsed) / rendered.timing_factor;
+        }
+
+        GdDirectionEnum move = MV_STILL;
+        bool fire = false;
+        if (rendered.player_state == GD_PL_LIVING) {
+            /* the greedy player goes for the nearest diamond three times of four */
+            GdDirectionEnum step;
+            if (policy == GD_PLAY_GREEDY && random.rand_int_range(0, 4) != 0 && gd_cave_path_to_goal(rendered, &step) >= 0)
+                move = step;
+            else
+                random_input.next(move, fire);
+        }
+        rendered.iterate(move, fire, false);
+        /* nobody draws the particles, so do not let them pile up */
+        rendered.particles.clear();
+
+        if (rendered.player_state == GD_PL_EXITED) {
+            run.outcome = GD_OUTCOME_EXITED;
+            run.frames = frame + 1;
+            run.seconds = double(rendered.time_elapsed) / rendered.timing_factor;
+            run.time_left = rendered.time / rendered.timing_factor;
+            break;
+        }
+        if (rendered.player_state == GD_PL_TIMEOUT) {
+            run.outcome = GD_OUTCOME_TIMEOUT;
+            run.frames = frame + 1;
+            run.seconds = double(rendered.time_elapsed) / rendered.timing_factor;
+            break;
+        }
+        if (rendered.player_state == GD_PL_DIED) {
+            if (rendered.voodoo_touched)
+                run.outcome = GD_OUTCOME_VOODOO;
+            else if (vanished != GD_OUTCOME_UNFINISHED)
+                run.outcome = vanished;
+            else
+                run.outcome = seen_once ? surroundings.cause_of_death() : GD_OUTCOME_OTHER_DEATH;
+            break;
+        }
+        if (rendered.player_state == GD_PL_LIVING && rendered.player_seen_ago > 0 && vanished == GD_OUTCOME_UNFINISHED && seen_once)
+            vanished = surroundings.cause_of_death();
+        else if (rendered.player_seen_ago == 0)
+            vanished = GD_OUTCOME_UNFINISHED;
+    }
+    run.diamonds = rendered.diamonds_collected;
+    run.diamonds_needed = rendered.diamonds_needed;
+    return run;
+}
+
+
+/// Play a cave many times on each level, on a pool of worker threads.
+/// @param cave The cave to analyse.
+/// @param runs The number of playthroughs on each level.
+/// @param policy How the player moves.
+/// @param threads The number of worker threads, 0 to use all processors.
+/// @param done If not NULL, incremented after every playthrough, so another thread can show the progress.
+/// @param cancel If not NULL and set by another thread, the playthroughs not yet started are skipped;
+///     their outcome stays GD_OUTCOME_UNFINISHED.
+/// @return The playthroughs for each level. Only level 1, if the cave has no levels.
+std::vector<DifficultyLevel> gd_difficulty_analyse(CaveStored const &cave, int runs, GdPlayPolicy policy, unsigned threads,
+                                                   std::atomic<int> *done, std::atomic<bool> const *cancel) {
+    int levels = cave.has_levels() ? 5 : 1;
+    std::vector<DifficultyLevel> result(levels);
+    for (int level = 0; level < levels; ++level) {
+        result[level].level = level;
+        result[level].runs.resize(runs);
+    }
+    gd_parallel_for(levels * runs, threads, [&](unsigned i) {
+        if (cancel != NULL && *cancel)
+            return;
+        int level = i / runs, run = i % runs;
+        result[level].runs[run] = gd_difficulty_play(cave, level, run, policy, GD_DIFFICULTY_MAX_FRAMES);
+        if (done != NULL)
+            ++*done;
+    });
+    return result;
+}
+
+
+/// Analyse all caves of all cavesets given, and print a report to the standard output.
+/// For each cave and level, the percentages of the outcomes, and the percentiles
+/// of the time survived, the diamonds collected and the time left are printed.
+/// @param cavesets The cavesets to analyse.
+/// @param runs The number of playthroughs of each cave on each level.
+/// @param policy How the player moves.
+/// @param threads The number of worker threads, 0 to use all processors.
+/// @param csv_filename If not NULL, every playthrough is written to this file, one line each.
+void gd_difficulty_report(std::vector<CaveSet> const &cavesets, int runs, GdPlayPolicy policy, unsigned threads, char const *csv_filename) {
+    std::ofstream csv;
+    if (csv_filename != NULL) {
+        csv.open(csv_filename);
+        if (!csv) {
+            gd_critical(_("Cannot open file %s for writing"), csv_filename);
+            return;
+        }
+        csv << "caveset,cave,level,seed,policy,outcome,frames,seconds,diamonds,diamonds_needed,time_left\n";
+    }
+
+    long long simulations = 0, frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto const &caveset : cavesets) {
+        for (auto const &cave : caveset.caves) {
+            std::vector<DifficultyLevel> levels = gd_difficulty_analyse(cave, runs, policy, threads);
+            for (auto const &level : levels) {
+                g_print("%s", Printf("%s, %s, level %d: exited %.1f%%, timeout %.1f%%, died %.1f%% (crushed %.1f%%, creature %.1f%%, explosion %.1f%%, voodoo %.1f%%, other %.1f%%)\n",
+                                     caveset.filename, cave.name, level.level + 1,
+                                     level.percent(GD_OUTCOME_EXITED), level.percent(GD_OUTCOME_TIMEOUT), level.percent_died(),
+                                     level.percent(GD_OUTCOME_CRUSHED), level.percent(GD_OUTCOME_CREATURE), level.percent(GD_OUTCOME_EXPLOSION),
+                                     level.percent(GD_OUTCOME_VOODOO), level.percent(GD_OUTCOME_OTHER_DEATH)).c_str());
+                g_print("%s", Printf("    survived %.0f/%.0f/%.0f s, diamonds %.0f/%.0f/%.0f of %d",
+                                     level.seconds_percentile(0.1), level.seconds_percentile(0.5), level.seconds_percentile(0.9),
+                                     level.diamonds_percentile(0.1), level.diamonds_percentile(0.5), level.diamonds_percentile(0.9),
+                                     level.runs.empty() ? 0 : level.runs[0].diamonds_needed).c_str());
+                if (level.percent(GD_OUTCOME_EXITED) > 0)
+                    g_print("%s", Printf(", time left when exited %.0f/%.0f/%.0f s",
+                                         level.time_left_percentile(0.1), level.time_left_percentile(0.5), level.time_left_percentile(0.9)).c_str());
+                g_print(" (10th percentile/median/90th percentile)\n");
+                for (auto const &run : level.runs) {
+                    simulations++;
+                    frames += run.frames;
+                    if (csv.is_open())
+                        csv << Printf("%s,%s,%d,%d,%s,%s,%d,%.2f,%d,%d,%d\n",
+                                      gd_csv_quote(caveset.filename), gd_csv_quote(cave.name), level.level + 1, run.seed,
+                                      gd_play_policy_name(policy), gd_play_outcome_name(run.outcome),
+                                      run.frames, run.seconds, run.diamonds, run.diamonds_needed, run.time_left).c_str();
+                }
+            }
+        }
+    }
+    double wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    g_print("%s", Printf("%d simulations, %d frames in %.2f s on %d threads: %.1f simulations/s, %.0f frames/s\n",
+                         simulations, frames, wall_time, threads > 0 ? threads : gd_parallel_default_threads(),
+                         wall_time > 0 ? simulations / wall_time : 0.0, wall_time > 0 ? frames / wall_time : 0.0).c_str());
+}
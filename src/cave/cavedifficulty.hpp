@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef CAVEDIFFICULTY_HPP_INCLUDED
+#define CAVEDIFFICULTY_HPP_INCLUDED
+
+#include "config.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+class CaveSet;
+class CaveStored;
+
+/// @ingroup Cave
+/// How the player is moved in the playthroughs of the difficulty analysis.
+enum GdPlayPolicy {
+    GD_PLAY_RANDOM,     ///< random movements, like ScriptedInput
+    GD_PLAY_GREEDY,     ///< mostly walking towards the nearest diamond or the open exit, sometimes random
+};
+
+/// @ingroup Cave
+/// How a playthrough ended.
+enum GdPlayOutcome {
+    GD_OUTCOME_EXITED,          ///< the player got out of the cave
+    GD_OUTCOME_TIMEOUT,         ///< the time ran out
+    GD_OUTCOME_CRUSHED,         ///< died; something fell on the player
+    GD_OUTCOME_CREATURE,        ///< died; a creature was next to the player
+    GD_OUTCOME_EXPLOSION,       ///< died; an explosion was next to the player
+    GD_OUTCOME_VOODOO,          ///< died; the voodoo was destroyed
+    GD_OUTCOME_OTHER_DEATH,     ///< died of some other cause
+    GD_OUTCOME_UNFINISHED,      ///< still playing after the maximum number of frames
+    GD_OUTCOME_MAX
+};
+
+/// @ingroup Cave
+/// The result of one playthrough.
+struct Playthrough {
+    int seed = 0;               ///< seed the cave was rendered with; also seeds the movements
+    GdPlayOutcome outcome = GD_OUTCOME_UNFINISHED;
+    int frames = 0;             ///< number of frames the player was alive
+    double seconds = 0;         ///< cave time the player was alive, in seconds
+    int diamonds = 0;           ///< diamonds collected
+    int diamonds_needed = 0;    ///< diamonds needed to open the exit
+    int time_left = 0;          ///< seconds remaining when the player exited
+};
+
+/// @ingroup Cave
+/// The playthroughs of a cave on one level, and the distributions of their results.
+struct DifficultyLevel {
+    int level = 0;                  ///< level, 0 is level 1
+    std::vector<Playthrough> runs;
+
+    double percent(GdPlayOutcome outcome) const;
+    double percent_died() const;
+    double seconds_percentile(double p) const;
+    double diamonds_percentile(double p) const;
+    double time_left_percentile(double p) const;
+};
+
+char const *gd_play_policy_name(GdPlayPolicy policy);
+bool gd_play_policy_from_string(const char *str, GdPlayPolicy &policy);
+char const *gd_play_outcome_name(GdPlayOutcome outcome);
+
+Playthrough gd_difficulty_play(CaveStored const &cave, int level, int seed, GdPlayPolicy policy, int max_frames);
+std::vector<DifficultyLevel> gd_difficulty_analyse(CaveStored const &cave, int runs, GdPlayPolicy policy, unsigned threads,
+                                                   std::atomic<int> *done = NULL, std::atomic<bool> const *cancel = NULL);
+void gd_difficulty_report(std::vector<CaveSet> const &cavesets, int runs, GdPlayPolicy policy, unsigned threads, char const *csv_filename);
+
+#endif
@@ -23,6 +23,7 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <cstdlib>
 
 #include "cave/caverendered.hpp"
@@ -46,7 +47,7 @@ void CaveRendered::set_ckdelay_extra_for_animation() {
     ckdelay_current = 0;
     for (int y = 0; y < height(); y++)
         for (int x = 0; x < width(); x++) {
-            ckdelay_current += gd_element_properties[map(x, y)].ckdelay;
+            ckdelay_current += gd_element_engine.ckdelay[map(x, y)];
             switch (map(x, y)) {
                 case O_FIREFLY_1:
                 case O_FIREFLY_2:
@@ -117,13 +118,15 @@ void CaveRendered::setup_for_game() {
 
     /* setup maps */
     objects_order.remove();  /* only needed by the editor */
-    if (hammered_walls_reappear)
-        hammered_reappear.set_size(w, h, 0);
+    hammered_walls.clear();
     /* set cave get function; to implement perfect or lineshifting borders */
     if (lineshift)
         map.set_wrap_type(CaveMapFuncs::LineShift);
     else
         map.set_wrap_type(CaveMapFuncs::Perfect);
+    select_iterate_func();
+    index_teleporters();
+    index_amoeba_food();
 
     /* set speed */
     set_ckdelay_extra_for_animation();
@@ -170,7 +173,9 @@ void CaveRendered::count_diamonds() {
 /// @param bonus_life_flash Set to true, if the player got a bonus life. The space element will change accordingly.
 /// @param animcycle Animation cycle - an integer between 0 and 7 to select animated frames.
 /// @param hate_invisible_outbox Show invisible outboxes as visible (blinking) ones.
-void CaveRendered::draw_indexes(CaveMap<int> &gfx_buffer, CaveMap<bool> const &covered, bool bonus_life_flash, int animcycle, bool hate_invisible_outbox) {
+/// @param area The cells on the screen. Only these are updated in gfx_buffer; the area is clipped
+///     to the visible part of the cave (x1..x2, y1..y2). For large caves this is much less work.
+void CaveRendered::draw_indexes(CaveMap<int> &gfx_buffer, CaveMap<bool> const &covered, bool bonus_life_flash, int animcycle, bool hate_invisible_outbox, CellRect const &area) {
     int elemdrawing[O_MAX_INDEX];
 
     g_assert(!map.empty());
@@ -264,8 +269,10 @@ void CaveRendered::draw_indexes(CaveMap<int> &gfx_buffer, CaveMap<bool> const &c
         elemdrawing[O_INVIS_OUTBOX] = elemdrawing[O_OUTBOX];
     }
 
-    for (int y = y1; y <= y2; y++) {
-        for (int x = x1; x <= x2; x++) {
+    int const xmin = std::max<int>(x1, area.x1), xmax = std::min<int>(x2, area.x2);
+    int const ymin = std::max<int>(y1, area.y1), ymax = std::min<int>(y2, area.y2);
+    for (int y = ymin; y <= ymax; y++) {
+        for (int x = xmin; x <= xmax; x++) {
             int draw;
 
             if (covered(x, y))          /* if covered, real element is not important */
@@ -389,7 +396,7 @@ void CaveRendered::store_rc(int x, int y, GdElementEnum element, int order_idx)
     /* if the above wraparound code fixed the coordinates, this will always be true. */
     /* if lineshift drawing is enabled, y might be negative or overflow. */
     if (x >= 0 && x < w && y >= 0 && y < h) {
-        map(x, y) = element;
+        map.set(x, y, element);
         objects_order(x, y) = order_idx;
     }
 }
@@ -438,22 +445,22 @@ void CaveRendered::create_map(CaveStored const &data, int level) {
                 if (randm < data.random_fill_probability_4)
                     element = data.random_fill_4;
 
-                map(x, y) = element;
+                map.set(x, y, element);
             }
         }
 
         /* draw initial border */
         for (int y = 0; y < h; y++) {
-            map(0, y) = data.initial_border;
-            map(w - 1, y) = data.initial_border;
+            map.set(0, y, data.initial_border);
+            map.set(w - 1, y, data.initial_border);
         }
         for (int x = 0; x < w; x++) {
-            map(x, 0) = data.initial_border;
-            map(x, h - 1) = data.initial_border;
+            map.set(x, 0, data.initial_border);
+            map.set(x, h - 1, data.initial_border);
         }
     } else {
         /* if the cave has a map, simply use it, no need to fill with random elements */
-        map = data.map;
+        map.assign(data.map);
         /* initialize c64 predictable random for slime. the values were taken from afl bd, see docs/internals.txt */
         c64_rand.set_seed(0, 0x1e);
     }
@@ -520,9 +527,14 @@ CaveRendered::CaveRendered(CaveStored const &data, int level, int seed)
         speed = 120;
 
     gd_cave_correct_visible_size(*this);
+    select_iterate_func();
+    index_teleporters();
+    index_amoeba_food();
 
     last_direction = MV_STILL;
     last_horizontal_direction = MV_STILL;
+    /* only used after a gravity switch; but set, so save states of the same game are the same */
+    gravity_next_direction = MV_STILL;
 }
 
 
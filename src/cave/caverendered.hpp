@@ -27,12 +27,16 @@
 #include "config.h"
 
 #include <glib.h>
+#include <bitset>
+#include <cstdint>
 #include <list>
+#include <vector>
 
 #include "cave/cavebase.hpp"
 #include "cave/helper/caverandom.hpp"
 #include "cave/helper/cavesound.hpp"
 #include "cave/helper/cavemap.hpp"
+#include "cave/helper/cavemapcompact.hpp"
 #include "cave/particle.hpp"
 
 class CaveStored;
@@ -66,6 +70,18 @@ enum AmoebaState {
 /// For signalling a cell to be redrawn in the graphics map.
 enum { GD_REDRAW = 1 << 10 };
 
+/// A rectangle of cells; all coordinates are inclusive.
+/// Used to process only the part of the cave which is on the screen.
+struct CellRect {
+    int x1, y1, x2, y2;
+};
+
+/// A wall destroyed by the pneumatic hammer, which will reappear.
+struct HammeredWall {
+    int x, y;           ///< Coordinates of the cell.
+    int frames_left;    ///< The wall reappears when this counts down to zero.
+};
+
 
 /// @ingroup Cave
 class CaveRendered : public CaveBase {
@@ -111,12 +127,47 @@ private:
     GdElementEnum get(int x, int y, GdDirectionEnum dir) const;
     void store(int x, int y, GdElementEnum element, bool disable_particle = false);
     void store(int x, int y, GdDirectionEnum dir, GdElementEnum element);
+    void store_cell(int i, int x, int y, GdElementEnum element);
     void move(int x, int y, GdDirectionEnum dir, GdElementEnum element);
     void next(int x, int y);
     void unscan(int x, int y);
     
     void update_scheduling();
 
+    /// The iterate function specialized for the flags of this cave, selected by select_iterate_func().
+    GdDirectionEnum (CaveRendered::*iterate_func)(GdDirectionEnum player_move, bool player_fire, bool suicide);
+    void select_iterate_func();
+    template <bool BorderScan>
+    GdDirectionEnum iterate_cave(GdDirectionEnum player_move, bool player_fire, bool suicide);
+    template <typename FUNC>
+    void for_each_cell(int ymin, int ymax, FUNC func);
+
+    /// Indices of the map cells which have a teleporter, in the order of the cave scan.
+    /// Updated by store(); used by do_teleporter() to find the next one.
+    std::vector<int> teleporters;
+
+    /// For each cell of the map, the number of its neighbours which the amoeba can eat.
+    /// Kept up to date by set_cell(), so the cave scan can tell if an amoeba is enclosed
+    /// without reading its neighbours. Only counted if the cave had amoeba when
+    /// indexed by index_amoeba_food(); otherwise empty.
+    std::vector<uint8_t> amoeba_food;
+    bool amoeba_food_counted = false;
+    void update_amoeba_food(int cell, int delta);
+    bool amoeba_can_grow(int x, int y, int cell) const;
+    void set_cell(int i, GdElementEnum element);
+
+    /// The cells written in the last frame, as indices of the real cells in the map, in the order
+    /// of the first write. changed_stamp holds the generation of the frame in which a cell was
+    /// listed last, so every cell is listed once. Only collected after track_changed_cells().
+    std::vector<int> frame_changes;
+    std::vector<uint16_t> changed_stamp;
+    uint16_t changed_generation = 0;
+    void begin_changed_cells();
+
+    /// Elements which were seen to do nothing in the cave scan. Only collected with active_cell_scan.
+    std::bitset<O_MAX> idle_elements;
+    bool is_idle_element(GdElementEnum e) const;
+
 public:
     CaveRendered(CaveStored const &cave, int level, int seed);
     void create_map(CaveStored const &data, int level);
@@ -126,7 +177,7 @@ public:
     void set_ckdelay_extra_for_animation();
 
     /* game playing helpers */
-    void draw_indexes(CaveMap<int> &gfx_buffer, CaveMap<bool> const &covered, bool bonus_life_flash, int animcycle, bool hate_invisible_outbox);
+    void draw_indexes(CaveMap<int> &gfx_buffer, CaveMap<bool> const &covered, bool bonus_life_flash, int animcycle, bool hate_invisible_outbox, CellRect const &area);
     int time_visible(int internal_time) const;
     void set_seconds_sound();
     void sound_play(GdSound sound, int x, int y);
@@ -135,6 +186,15 @@ public:
     void store_rc(int x, int y, GdElementEnum element, int order_idx);
 
     bool do_teleporter(int px, int py, GdDirectionEnum player_move);
+    void index_teleporters();
+    void index_amoeba_food();
+    void track_changed_cells();
+    /// The cells changed by the last iterate(), as indices of the map; see track_changed_cells().
+    std::vector<int> const &changed_cells() const {
+        return frame_changes;
+    }
+    void add_hammered_wall(int x, int y);
+    void update_teleporter_index(int cell, bool teleporter);
     bool do_push(int x, int y, GdDirectionEnum player_move, bool player_fire);
 
     void do_start_fall(int x, int y, GdDirectionEnum falling_direction, GdElementEnum falling_element);
@@ -147,8 +207,12 @@ public:
 
     // Cave maps
     CaveMap<int> objects_order;         ///< two-dimensional map of cave; each cell is an index to the drawing object, which created this element. -1 if map or random
-    CaveMap<int> hammered_reappear;     ///< integer map of cave; if non-zero, a brick wall will appear there
-    CaveMap<GdElementEnum> map;         ///< cave map
+    std::vector<HammeredWall> hammered_walls;   ///< walls which will reappear, in the order of the cave scan
+    CaveMapCompact map;                 ///< cave map
+    /// Scan only the active cells of the map, skipping the ones known to do nothing.
+    /// The result of iterate() is the same, but much faster for caves with a lot of walls
+    /// and dirt. Off by default; intended for bulk simulation of caves.
+    bool active_cell_scan = false;
 
     // Variables for random number generation
     GdInt render_seed;                  ///< the seed value, which was used to render the cave, is saved here. will be used by record&playback
@@ -213,7 +277,7 @@ public:
     GdBool voodoo_touched;
 
     SoundWithPos sound1, sound2, sound3;        ///< sound set for 3 channels after each iteration
-    std::list<ParticleSet> particles;
+    ParticlePool particles;
     GdColor dirt_particle_color, dirt_2_particle_color, diamond_particle_color,
             stone_particle_color, mega_stone_particle_color,
             explosion_particle_color, magic_wall_particle_color, expanding_wall_particle_color,
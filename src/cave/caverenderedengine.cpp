@@ -23,10 +23,12 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <cmath>
 
 #include "cave/caverendered.hpp"
 #include "cave/elementproperties.hpp"
+#include "cave/engineprofile.hpp"
 #include "settings.hpp"
 
 
@@ -55,67 +57,67 @@ void CaveRendered::add_particle_set(int x, int y, GdElementEnum particletype) {
     double gx = gd_dx[gravity], gy = gd_dy[gravity], agx = fabs(gx), agy = fabs(gy);
     switch (particletype) {
         case O_DIRT:
-            particles.push_back(ParticleSet(75, 0.1, 0.15, x + 0.5, y + 0.5, 0.5, 0.5, 0, 0, 1, 1, dirt_particle_color));
+            particles.add(75, 0.1, 0.15, x + 0.5, y + 0.5, 0.5, 0.5, 0, 0, 1, 1, dirt_particle_color);
             break;
         case O_DIRT2:
-            particles.push_back(ParticleSet(75, 0.1, 0.15, x + 0.5, y + 0.5, 0.5, 0.5, 0, 0, 1, 1, dirt_2_particle_color));
+            particles.add(75, 0.1, 0.15, x + 0.5, y + 0.5, 0.5, 0.5, 0, 0, 1, 1, dirt_2_particle_color);
             break;
         case O_STONE_F:
-            particles.push_back(ParticleSet(75, 0.1, 0.15,
-                                            x + 0.5 + 0.5 * gx, y + 0.5 + 0.5 * gy, 0.25 + 0.25 * agy, 0.25 + 0.25 * agx,
-                                            0.5 * gx, 0.5 * gy, 1 + agy, 1 + agx, stone_particle_color));
+            particles.add(75, 0.1, 0.15,
+                          x + 0.5 + 0.5 * gx, y + 0.5 + 0.5 * gy, 0.25 + 0.25 * agy, 0.25 + 0.25 * agx,
+                          0.5 * gx, 0.5 * gy, 1 + agy, 1 + agx, stone_particle_color);
             break;
         case O_MEGA_STONE_F:
-            particles.push_back(ParticleSet(75, 0.1, 0.15,
-                                            x + 0.5 + 0.5 * gx, y + 0.5 + 0.5 * gy, 0.25 + 0.25 * agy, 0.25 + 0.25 * agx,
-                                            0.5 * gx, 0.5 * gy, 1 + agy, 1 + agx, mega_stone_particle_color));
+            particles.add(75, 0.1, 0.15,
+                          x + 0.5 + 0.5 * gx, y + 0.5 + 0.5 * gy, 0.25 + 0.25 * agy, 0.25 + 0.25 * agx,
+                          0.5 * gx, 0.5 * gy, 1 + agy, 1 + agx, mega_stone_particle_color);
             break;
         case O_DIAMOND_F:
             /* falling diamond */
-            particles.push_back(ParticleSet(15, 0.03, 0.5,
-                                            x + 0.5 + 0.5 * gx, y + 0.5 + 0.5 * gy, 0.25, 0.25,
-                                            0, 0, 2, 2, diamond_particle_color));
+            particles.add(15, 0.03, 0.5,
+                          x + 0.5 + 0.5 * gx, y + 0.5 + 0.5 * gy, 0.25, 0.25,
+                          0, 0, 2, 2, diamond_particle_color);
             break;
         case O_DIAMOND:
             /* collecting diamond */
-            particles.push_back(ParticleSet(8, 0.03, 0.5,
-                                            x + 0.5, y + 0.5, 0.25, 0.25,
-                                            0, 0, 2, 2, diamond_particle_color));
+            particles.add(8, 0.03, 0.5,
+                          x + 0.5, y + 0.5, 0.25, 0.25,
+                          0, 0, 2, 2, diamond_particle_color);
             break;
         case O_EXPLODE_1:
             /* for explosions, the original place of the particles is a 2x2 cave cell area, but they
              * expand rapidly. */
-            particles.push_back(ParticleSet(300, 0.05, 0.5, x + 0.5, y + 0.5, 1.0, 1.0, 0, 0, 4, 4, explosion_particle_color));
+            particles.add(300, 0.05, 0.5, x + 0.5, y + 0.5, 1.0, 1.0, 0, 0, 4, 4, explosion_particle_color);
             break;
         case O_PRE_DIA_1:
-            particles.push_back(ParticleSet(300, 0.05, 0.5, x + 0.5, y + 0.5, 1.0, 1.0, 0, 0, 4, 4, diamond_particle_color));
+            particles.add(300, 0.05, 0.5, x + 0.5, y + 0.5, 1.0, 1.0, 0, 0, 4, 4, diamond_particle_color);
             break;
         case O_MAGIC_WALL:
             // a magic wall creates particles in every frame. so add only very few particles!
             // rather they should be bright like stars
-            particles.push_back(ParticleSet(3, 0.01, 0.75, x + 0.5, y + 0.5, 0.5, 0.5, 0, 0, 1 + 2 * agx, 1 + 2 * agy, magic_wall_particle_color));
+            particles.add(3, 0.01, 0.75, x + 0.5, y + 0.5, 0.5, 0.5, 0, 0, 1 + 2 * agx, 1 + 2 * agy, magic_wall_particle_color);
             break;
         case O_EXPANDING_WALL:
-            particles.push_back(ParticleSet(75, 0.1, 0.15, x + 0.5, y + 0.5, 0.5, 0.5, 0, 0, 1, 1, expanding_wall_particle_color));
+            particles.add(75, 0.1, 0.15, x + 0.5, y + 0.5, 0.5, 0.5, 0, 0, 1, 1, expanding_wall_particle_color);
             break;
         case O_EXPANDING_STEEL_WALL:
-            particles.push_back(ParticleSet(75, 0.1, 0.15, x + 0.5, y + 0.5, 0.5, 0.5, 0, 0, 1, 1, expanding_steel_wall_particle_color));
+            particles.add(75, 0.1, 0.15, x + 0.5, y + 0.5, 0.5, 0.5, 0, 0, 1, 1, expanding_steel_wall_particle_color);
             break;
         case O_LAVA:
             // this should look like it's boiling
-            particles.push_back(ParticleSet(10, 0.01, 0.5, x + 0.5, y + 0.5, 0.5, 0.5, 0, 0, 2, 2, lava_particle_color));
+            particles.add(10, 0.01, 0.5, x + 0.5, y + 0.5, 0.5, 0.5, 0, 0, 2, 2, lava_particle_color);
             break;
         case O_ROCKET_1:
-            particles.push_back(ParticleSet(100, 0.03, 0.25, x + 0.9, y + 0.5, 0.5, 0.2, -4, 0.2, 3, 0.2, explosion_particle_color));
+            particles.add(100, 0.03, 0.25, x + 0.9, y + 0.5, 0.5, 0.2, -4, 0.2, 3, 0.2, explosion_particle_color);
             break;
         case O_ROCKET_2:
-            particles.push_back(ParticleSet(100, 0.03, 0.25, x + 0.5, y + 0.1, 0.2, 0.5, 0.2, 4, 0.2, 3, explosion_particle_color));
+            particles.add(100, 0.03, 0.25, x + 0.5, y + 0.1, 0.2, 0.5, 0.2, 4, 0.2, 3, explosion_particle_color);
             break;
         case O_ROCKET_3:
-            particles.push_back(ParticleSet(100, 0.03, 0.25, x + 0.1, y + 0.5, 0.5, 0.2, 4, 0.2, 3, 0.2, explosion_particle_color));
+            particles.add(100, 0.03, 0.25, x + 0.1, y + 0.5, 0.5, 0.2, 4, 0.2, 3, 0.2, explosion_particle_color);
             break;
         case O_ROCKET_4:
-            particles.push_back(ParticleSet(100, 0.03, 0.25, x + 0.5, y + 0.9, 0.2, 0.5, 0.2, -4, 0.2, 3, explosion_particle_color));
+            particles.add(100, 0.03, 0.25, x + 0.5, y + 0.9, 0.2, 0.5, 0.2, -4, 0.2, 3, explosion_particle_color);
             break;
         default:
             break;
@@ -127,6 +129,7 @@ void CaveRendered::add_particle_set(int x, int y, GdElementEnum particletype) {
 /// The sound1, sound2 and sound3 variables will be handled by a game implementation.
 /// This function only remembers to play them. It also checks the precedences.
 void CaveRendered::sound_play(GdSound sound, int x, int y) {
+    GD_PROFILE_SCOPE(PhaseSound);
     switch (sound) {
         case GD_S_NONE:
             return;
@@ -512,22 +515,30 @@ inline GdElementEnum CaveRendered::get(int x, int y) const {
 
 /// Returns the element at (x,y)+dir.
 inline GdElementEnum CaveRendered::get(int x, int y, GdDirectionEnum dir) const {
-    return get(x + gd_dx[dir], y + gd_dy[dir]);
+    return map.at(map.index(x, y, dir));
 }
 
 /// Returns true, if element at (x,y)+dir explodes if hit by a stone (for example, a firefly).
 inline bool CaveRendered::explodes_by_hit(int x, int y, GdDirectionEnum dir) const {
-    return (gd_element_properties[get(x, y, dir)].flags & P_EXPLODES_BY_HIT) != 0;
+    return (gd_element_engine.flags[get(x, y, dir)] & P_EXPLODES_BY_HIT) != 0;
 }
 
 /// returns true, if the element is not explodable (for example the steel wall).
 inline bool CaveRendered::non_explodable(int x, int y) const {
-    return (gd_element_properties[get(x, y)].flags & P_NON_EXPLODABLE) != 0;
+    return (gd_element_engine.flags[get(x, y)] & P_NON_EXPLODABLE) != 0;
 }
 
 /// returns true, if the element at (x,y)+dir can be eaten by the amoeba (dirt, space)
 inline bool CaveRendered::amoeba_eats(int x, int y, GdDirectionEnum dir) const {
-    return (gd_element_properties[get(x, y, dir)].flags & P_AMOEBA_CONSUMES) != 0;
+    return (gd_element_engine.flags[get(x, y, dir)] & P_AMOEBA_CONSUMES) != 0;
+}
+
+/// returns true, if the amoeba at (x,y) has a neighbour it can eat.
+/// @param cell The index of (x,y) in the map. If the food of the amoeba is counted, only this is used.
+inline bool CaveRendered::amoeba_can_grow(int x, int y, int cell) const {
+    if (amoeba_food_counted)
+        return amoeba_food[cell] != 0;
+    return amoeba_eats(x, y, MV_UP) || amoeba_eats(x, y, MV_DOWN) || amoeba_eats(x, y, MV_LEFT) || amoeba_eats(x, y, MV_RIGHT);
 }
 
 /// Returns true if the element is sloped, so stones and diamonds roll down on it.
@@ -541,13 +552,13 @@ inline bool CaveRendered::amoeba_eats(int x, int y, GdDirectionEnum dir) const {
 bool CaveRendered::sloped(int x, int y, GdDirectionEnum dir, GdDirectionEnum slop) const {
     switch (slop) {
         case MV_LEFT:
-            return (gd_element_properties[get(x, y, dir)].flags & P_SLOPED_LEFT) != 0;
+            return (gd_element_engine.flags[get(x, y, dir)] & P_SLOPED_LEFT) != 0;
         case MV_RIGHT:
-            return (gd_element_properties[get(x, y, dir)].flags & P_SLOPED_RIGHT) != 0;
+            return (gd_element_engine.flags[get(x, y, dir)] & P_SLOPED_RIGHT) != 0;
         case MV_UP:
-            return (gd_element_properties[get(x, y, dir)].flags & P_SLOPED_UP) != 0;
+            return (gd_element_engine.flags[get(x, y, dir)] & P_SLOPED_UP) != 0;
         case MV_DOWN:
-            return (gd_element_properties[get(x, y, dir)].flags & P_SLOPED_DOWN) != 0;
+            return (gd_element_engine.flags[get(x, y, dir)] & P_SLOPED_DOWN) != 0;
         default:
             break;
     }
@@ -557,53 +568,53 @@ bool CaveRendered::sloped(int x, int y, GdDirectionEnum dir, GdDirectionEnum slo
 
 /// returns true if the element is sloped for bladder movement (brick=yes, diamond=no, for example)
 inline bool CaveRendered::sloped_for_bladder(int x, int y, GdDirectionEnum dir) const {
-    return (gd_element_properties[get(x, y, dir)].flags & P_BLADDER_SLOPED) != 0;
+    return (gd_element_engine.flags[get(x, y, dir)] & P_BLADDER_SLOPED) != 0;
 }
 
 /// returns true if the element at (x,y)+dir can blow up a fly by touching it.
 inline bool CaveRendered::blows_up_flies(int x, int y, GdDirectionEnum dir) const {
-    return (gd_element_properties[get(x, y, dir)].flags & P_BLOWS_UP_FLIES) != 0;
+    return (gd_element_engine.flags[get(x, y, dir)] & P_BLOWS_UP_FLIES) != 0;
 }
 
 /// returns true if the element is a counter-clockwise creature
 inline bool CaveRendered::rotates_ccw(int x, int y) const {
-    return (gd_element_properties[get(x, y)].flags & P_CCW) != 0;
+    return (gd_element_engine.flags[get(x, y)] & P_CCW) != 0;
 }
 
 /// returns true if the element is a player (normal player, player glued, player with bomb)
 bool CaveRendered::is_player(int x, int y) const {
-    return (gd_element_properties[get(x, y)].flags & P_PLAYER) != 0;
+    return (gd_element_engine.flags[get(x, y)] & P_PLAYER) != 0;
 }
 
 /// returns true if the element at (x,y)+dir is a player (normal player, player glued, player with bomb)
 bool CaveRendered::is_player(int x, int y, GdDirectionEnum dir) const {
-    return (gd_element_properties[get(x, y, dir)].flags & P_PLAYER) != 0;
+    return (gd_element_engine.flags[get(x, y, dir)] & P_PLAYER) != 0;
 }
 
 /// returns true if the element at (x,y)+dir can be hammered.
 inline bool CaveRendered::can_be_hammered(int x, int y, GdDirectionEnum dir) const {
-    return (gd_element_properties[get(x, y, dir)].flags & P_CAN_BE_HAMMERED) != 0;
+    return (gd_element_engine.flags[get(x, y, dir)] & P_CAN_BE_HAMMERED) != 0;
 }
 
 /// Returns true if the element at (x,y)+dir can be pushed.
 /// @todo should be inlined.
 bool CaveRendered::can_be_pushed(int x, int y, GdDirectionEnum dir) const {
-    return (gd_element_properties[get(x, y, dir)].flags & P_CAN_BE_PUSHED) != 0;
+    return (gd_element_engine.flags[get(x, y, dir)] & P_CAN_BE_PUSHED) != 0;
 }
 
 /// returns true if the element at (x,y) is the first animation stage of an explosion
 inline bool CaveRendered::is_first_stage_of_explosion(int x, int y) const {
-    return (gd_element_properties[get(x, y)].flags & P_EXPLOSION_FIRST_STAGE) != 0;
+    return (gd_element_engine.flags[get(x, y)] & P_EXPLOSION_FIRST_STAGE) != 0;
 }
 
 /// returns true if the element sits on and is moved by the conveyor belt
 inline bool CaveRendered::moved_by_conveyor_top(int x, int y, GdDirectionEnum dir) const {
-    return (gd_element_properties[get(x, y, dir)].flags & P_MOVED_BY_CONVEYOR_TOP) != 0;
+    return (gd_element_engine.flags[get(x, y, dir)] & P_MOVED_BY_CONVEYOR_TOP) != 0;
 }
 
 /// returns true if the elements floats upwards, and is conveyed by the conveyor belt which is OVER it
 inline bool CaveRendered::moved_by_conveyor_bottom(int x, int y, GdDirectionEnum dir) const {
-    return (gd_element_properties[get(x, y, dir)].flags & P_MOVED_BY_CONVEYOR_BOTTOM) != 0;
+    return (gd_element_engine.flags[get(x, y, dir)] & P_MOVED_BY_CONVEYOR_BOTTOM) != 0;
 }
 
 /// returns true if the element is a scanned one (needed by the engine)
@@ -613,7 +624,7 @@ inline bool CaveRendered::is_scanned(int x, int y) const {
 
 /// returns true if the element is a scanned one (needed by the engine)
 inline bool CaveRendered::is_scanned(int x, int y, GdDirectionEnum dir) const {
-    return is_scanned_element(get(x + gd_dx[dir], y + gd_dy[dir]));
+    return is_scanned_element(get(x, y, dir));
 }
 
 /// Returns true if neighboring element is "e", or equivalent to "e".
@@ -631,9 +642,9 @@ bool CaveRendered::is_like_element(int x, int y, GdDirectionEnum dir, GdElementE
     int examined = get(x, y, dir);
 
     /* if it is a dirt-like, change to dirt, so equality will evaluate to true */
-    if (gd_element_properties[examined].flags & P_DIRT)
+    if (gd_element_engine.flags[examined] & P_DIRT)
         examined = O_DIRT;
-    if (gd_element_properties[e].flags & P_DIRT)
+    if (gd_element_engine.flags[e] & P_DIRT)
         e = O_DIRT;
     /* if the element on the map is a lava, it should be like space */
     if (examined == O_LAVA)
@@ -665,7 +676,29 @@ inline bool CaveRendered::is_like_space(int x, int y, GdDirectionEnum dir) const
 /// (without exploding).
 /// Therefore 'if (map(x,y)==O_DIRT)' must not be used!
 inline bool CaveRendered::is_like_dirt(int x, int y, GdDirectionEnum dir) const {
-    return (gd_element_properties[get(x, y, dir)].flags & P_DIRT) != 0;
+    return (gd_element_engine.flags[get(x, y, dir)] & P_DIRT) != 0;
+}
+
+
+/// Write an element to the map at index i, as returned by map.index().
+/// All writes of the game engine go through this, so the food of the amoeba is counted,
+/// and the changed cells of the frame are listed.
+inline void CaveRendered::set_cell(int i, GdElementEnum element) {
+    if (amoeba_food_counted) {
+        int const cell = map.home(i);
+        bool const was_food = (gd_element_engine.flags[map.at(cell)] & P_AMOEBA_CONSUMES) != 0;
+        bool const is_food = (gd_element_engine.flags[element] & P_AMOEBA_CONSUMES) != 0;
+        if (was_food != is_food)
+            update_amoeba_food(cell, is_food ? +1 : -1);
+    }
+    map.set_at(i, element);
+    if (!changed_stamp.empty()) {
+        int const cell = map.home(i);
+        if (changed_stamp[cell] != changed_generation) {
+            changed_stamp[cell] = changed_generation;
+            frame_changes.push_back(cell);
+        }
+    }
 }
 
 
@@ -674,18 +707,28 @@ inline bool CaveRendered::is_like_dirt(int x, int y, GdDirectionEnum dir) const
 /// the map is NOT changed.
 /// The element given is changed to its "scanned" state, if there is such.
 inline void CaveRendered::store(int x, int y, GdElementEnum element, bool disable_particle) {
-    GdElementEnum &cell = map(x, y);
-    if (cell == O_LAVA) {
+    store_cell(map.index(x, y), x, y, element);
+}
+
+
+/// Store an element at index i of the map, as store() does.
+/// @param x The coordinates of the cell, for the sound of the lava.
+inline void CaveRendered::store_cell(int i, int x, int y, GdElementEnum element) {
+    GdElementEnum const old = map.at(i);
+    if (old == O_LAVA) {
         play_effect_of_element(O_LAVA, x, y);
         return;
     }
-    cell = scanned_pair(element);
+    GdElementEnum const stored = scanned_pair(element);
+    if ((old == O_TELEPORTER) != (stored == O_TELEPORTER))
+        update_teleporter_index(map.home(i), stored == O_TELEPORTER);
+    set_cell(i, stored);
 }
 
 
 /// Store an element to (x,y)+dir.
 inline void CaveRendered::store(int x, int y, GdDirectionEnum dir, GdElementEnum element) {
-    store(x + gd_dx[dir], y + gd_dy[dir], element);
+    store_cell(map.index(x, y, dir), x + gd_dx[dir], y + gd_dy[dir], element);
 }
 
 /// Store the element to (x,y)+dir, and store a space to (x,y).
@@ -697,14 +740,17 @@ inline void CaveRendered::move(int x, int y, GdDirectionEnum dir, GdElementEnum
 /// increment a cave element; can be used for elements which are one after the other, for example bladder1, bladder2, bladder3...
 /// @todo to be removed
 inline void CaveRendered::next(int x, int y) {
-    map(x, y) = GdElementEnum(map(x, y) + 1);
+    int i = map.index(x, y);
+    set_cell(i, GdElementEnum(map.at(i) + 1));
 }
 
 /// Remove th scanned "bit" from an element.
 /// To be called only for scanned elements!!!
 inline void CaveRendered::unscan(int x, int y) {
-    if (is_scanned(x, y))
-        map(x, y) = gd_element_properties[get(x, y)].pair;
+    if (is_scanned(x, y)) {
+        int i = map.index(x, y);
+        set_cell(i, GdElementEnum(gd_element_engine.pair[map.at(i)]));
+    }
 }
 
 
@@ -1108,27 +1154,102 @@ GdElementEnum CaveRendered::player_eat_element(GdElementEnum element, int x, int
    @return True, if the player is teleported, false, if no suitable teleporter found.
  */
 bool CaveRendered::do_teleporter(int px, int py, GdDirectionEnum player_move) {
-    int tx = px;
-    int ty = py;
-    bool teleported = false;
-    do {
-        /* jump to next element; wrap around columns and rows. */
-        tx++;
-        if (tx >= w) {
-            tx = 0;
-            ty++;
-            if (ty >= h)
-                ty = 0;
-        }
+    /* the teleporters after the player in the order of the scan, then wrap around to the first one.
+     * the player's own cell comes last, as in the original which walked the map cell by cell. */
+    int const from = map.home(map.index(px, py));
+    size_t const count = teleporters.size();
+    size_t const first = std::upper_bound(teleporters.begin(), teleporters.end(), from) - teleporters.begin();
+    for (size_t n = 0; n < count; ++n) {
+        int const cell = teleporters[(first + n) % count];
+        int const tx = map.x_of(cell), ty = map.y_of(cell);
         /* if we found a teleporter... */
-        if (get(tx, ty) == O_TELEPORTER && is_like_space(tx, ty, player_move)) {
+        if (is_like_space(tx, ty, player_move)) {
             store(tx, ty, player_move, get(px, py));    /* new player appears near teleporter found */
             store(px, py, O_SPACE); /* current player disappears */
             sound_play(GD_S_TELEPORTER, tx, ty);
-            teleported = true;  /* success */
+            return true;  /* success */
+        }
+    }
+    return false;
+}
+
+
+/// Remember a hammered wall, which will reappear after hammered_wall_reappear_frame frames.
+/// The list is kept in the order of the cave scan; if the cell already has a timer, it is restarted.
+void CaveRendered::add_hammered_wall(int x, int y) {
+    /* a zero timer never counts down */
+    if (hammered_wall_reappear_frame <= 0)
+        return;
+    HammeredWall const wall = {x, y, hammered_wall_reappear_frame};
+    auto it = std::lower_bound(hammered_walls.begin(), hammered_walls.end(), wall, [](HammeredWall const &a, HammeredWall const &b) {
+        return a.y < b.y || (a.y == b.y && a.x < b.x);
+    });
+    if (it != hammered_walls.end() && it->x == x && it->y == y)
+        *it = wall;
+    else
+        hammered_walls.insert(it, wall);
+}
+
+
+/// Collect the cells with a teleporter for do_teleporter().
+/// store_cell() keeps the index up to date, so this must only be called again
+/// when the map is changed in some other way, eg. when the cave is set up for
+/// the game, or a save state is loaded.
+void CaveRendered::index_teleporters() {
+    teleporters.clear();
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            if (map(x, y) == O_TELEPORTER)
+                teleporters.push_back(map.index(x, y));
+}
+
+
+/// Add a cell to the teleporter index, or remove it.
+/// @param cell The index of the real cell in the map.
+/// @param teleporter True, if a teleporter is put there, false if it is removed.
+void CaveRendered::update_teleporter_index(int cell, bool teleporter) {
+    auto it = std::lower_bound(teleporters.begin(), teleporters.end(), cell);
+    if (teleporter)
+        teleporters.insert(it, cell);
+    else if (it != teleporters.end() && *it == cell)
+        teleporters.erase(it);
+}
+
+/// Count the neighbours the amoeba can eat for every cell, if there is any amoeba in
+/// the cave; see amoeba_food. Must be called again if the map is changed other
+/// than by the game engine, or its wrap type changes.
+void CaveRendered::index_amoeba_food() {
+    amoeba_food_counted = false;
+    for (int y = 0; y < h && !amoeba_food_counted; y++)
+        for (int x = 0; x < w; x++) {
+            GdElementEnum e = nonscanned_pair(map(x, y));
+            if (e == O_AMOEBA || e == O_AMOEBA_2) {
+                amoeba_food_counted = true;
+                break;
+            }
         }
-    } while (!teleported && (tx != px || ty != py)); /* loop until we get back to original coordinates */
-    return teleported;
+    amoeba_food.clear();
+    if (!amoeba_food_counted)
+        return;
+    amoeba_food.resize(map.index(w - 1, h - 1) + 1);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            if ((gd_element_engine.flags[map(x, y)] & P_AMOEBA_CONSUMES) != 0)
+                update_amoeba_food(map.index(x, y), +1);
+}
+
+
+/// A cell became food for the amoeba (delta=+1), or stopped being food (delta=-1):
+/// update the counts of its neighbours. The map wraps around while playing, and the
+/// neighbour relation is symmetric for both kinds of wrapping, so the neighbours of
+/// the cell are the cells it is a neighbour of.
+/// @param cell The index of the real cell in the map.
+void CaveRendered::update_amoeba_food(int cell, int delta) {
+    int const x = map.x_of(cell), y = map.y_of(cell);
+    amoeba_food[map.home(map.index(x, y, MV_UP))] += delta;
+    amoeba_food[map.home(map.index(x, y, MV_DOWN))] += delta;
+    amoeba_food[map.home(map.index(x, y, MV_LEFT))] += delta;
+    amoeba_food[map.home(map.index(x, y, MV_RIGHT))] += delta;
 }
 
 /**
@@ -1461,7 +1582,82 @@ void CaveRendered::do_fall_roll_or_stop(int x, int y, GdDirectionEnum fall_dir,
 /// @param suicide True, if the suicide button is pressed.
 /// @return A new GdDirectionEnum, which might be changed to not have diagonal movements. This is to make stored replays neater.
 GdDirectionEnum CaveRendered::iterate(GdDirectionEnum player_move, bool player_fire, bool suicide) {
-    int ymin, ymax; /* for border scan */
+    if (!changed_stamp.empty())
+        begin_changed_cells();
+    return (this->*iterate_func)(player_move, player_fire, suicide);
+}
+
+
+/// Start listing the cells changed in every frame, to be read by changed_cells()
+/// after each iterate(). Users of the cave, for example a recorder, can then process
+/// only these instead of comparing the whole map to the previous frame.
+/// A cell is listed if it was written in the frame, which does not always mean that
+/// it has a different element at the end of it: for example an element might have
+/// moved away and another one moved in. Other changes of the map, like loading a
+/// saved state, are not listed.
+void CaveRendered::track_changed_cells() {
+    changed_stamp.assign(map.index(w - 1, h - 1) + 1, 0);
+    changed_generation = 1;
+    frame_changes.clear();
+}
+
+
+/// Empty the list of changed cells for a new frame.
+void CaveRendered::begin_changed_cells() {
+    frame_changes.clear();
+    if (++changed_generation == 0) {
+        /* the stamps of the old frames must not look like the ones of the new frames */
+        std::fill(changed_stamp.begin(), changed_stamp.end(), 0);
+        changed_generation = 1;
+    }
+}
+
+
+/// Select the specialization of iterate_cave() for the settings of this cave.
+/// Must be called again if the border scan setting is changed.
+void CaveRendered::select_iterate_func() {
+    if (border_scan_first_and_last)
+        iterate_func = &CaveRendered::iterate_cave<true>;
+    else
+        iterate_func = &CaveRendered::iterate_cave<false>;
+}
+
+
+/// Returns true, if a cell with this element does not need to be visited by the scan,
+/// nor by the passes after it. This is true for elements which were seen to do nothing
+/// in the scan, and have no ckdelay (as that is also added for every cell visited).
+inline bool CaveRendered::is_idle_element(GdElementEnum e) const {
+    return idle_elements[e]
+           && gd_element_engine.ckdelay[e] == 0
+           && (gd_element_engine.flags[e] & (P_SCANNED | P_EXPLOSION_FIRST_STAGE | P_PLAYER)) == 0
+           && e != O_TIME_PENALTY;
+}
+
+
+/// Call func(x, y, cell) for the cells in rows ymin..ymax, in row-major order.
+/// With active_cell_scan, the cells which are idle are skipped.
+template <typename FUNC>
+inline void CaveRendered::for_each_cell(int ymin, int ymax, FUNC func) {
+    for (int y = ymin; y <= ymax; y++) {
+        int const row = map.index(0, y);
+        if (active_cell_scan) {
+            for (int cell = map.next_active(row, row + w); cell < row + w; cell = map.next_active(cell + 1, row + w))
+                func(cell - row, y, cell);
+        } else {
+            for (int x = 0; x < w; x++)
+                func(x, y, row + x);
+        }
+    }
+}
+
+
+/// The cave iteration itself.
+/// The border scan setting is a template parameter, so the compiler can drop
+/// its test from the loop over the rows. The wrap type needs no specialization,
+/// as neighbours are read from the ghost cells of the map for both kinds of wrapping.
+/// @param BorderScan True, if the first and the last row is also scanned (border_scan_first_and_last).
+template <bool BorderScan>
+GdDirectionEnum CaveRendered::iterate_cave(GdDirectionEnum player_move, bool player_fire, bool suicide) {
     bool amoeba_found_enclosed, amoeba_2_found_enclosed;    /* amoeba found to be enclosed. if not, this is cleared */
     int amoeba_count, amoeba_2_count;       /* counting the number of amoebas. after scan, check if too much */
     bool inbox_toggle;
@@ -1473,6 +1669,7 @@ GdDirectionEnum CaveRendered::iterate(GdDirectionEnum player_move, bool player_f
     int time_decrement_sec;
     GdElement biter_try[] = { O_DIRT, biter_eat, O_SPACE, O_STONE }; /* biters eating elements preference, they try to go in this order */
 
+    GD_PROFILE_ITERATION_BEGIN();
     clear_sounds();
 
     if (gravity_affects_all)
@@ -1526,20 +1723,17 @@ GdDirectionEnum CaveRendered::iterate(GdDirectionEnum player_move, bool player_f
         store(player_x, player_y, O_EXPLODE_1);
 
     /* check for walls reappearing */
-    if (hammered_walls_reappear) {
-        for (int y = 0; y < h; y++)
-            for (int x = 0; x < w; x++) {
-                /* timer for the cell > 0? */
-                if (hammered_reappear(x, y) > 0) {
-                    /* decrease timer */
-                    hammered_reappear(x, y)--;
-                    /* check if it became zero */
-                    if (hammered_reappear(x, y) == 0) {
-                        store(x, y, O_BRICK);
-                        sound_play(GD_S_WALL_REAPPEAR, x, y);
-                    }
-                }
-            }
+    if (!hammered_walls.empty()) {
+        auto kept = hammered_walls.begin();
+        for (HammeredWall &wall : hammered_walls) {
+            /* decrease timer, and check if it became zero */
+            if (--wall.frames_left == 0) {
+                store(wall.x, wall.y, O_BRICK);
+                sound_play(GD_S_WALL_REAPPEAR, wall.x, wall.y);
+            } else
+                *kept++ = wall;
+        }
+        hammered_walls.erase(kept, hammered_walls.end());
     }
 
     /* variables to check during the scan */
@@ -1550,28 +1744,33 @@ GdDirectionEnum CaveRendered::iterate(GdDirectionEnum player_move, bool player_f
     ckdelay_current = 0;
     time_decrement_sec = 0;
 
+    GD_PROFILE_PHASE_DONE(PhasePrepare);
+
     /* check whether to scan the first and last line */
-    if (border_scan_first_and_last) {
-        ymin = 0;
-        ymax = h - 1;
-    } else {
-        ymin = 1;
-        ymax = h - 2;
-    }
-    /* the cave scan routine */
-    for (int y = ymin; y <= ymax; y++)
-        for (int x = 0; x < w; x++) {
+    int const ymin = BorderScan ? 0 : 1;
+    int const ymax = BorderScan ? h - 1 : h - 2;
+    /* the cave scan routine. with active cell scan, cells found idle were marked inactive.
+     * they are skipped, until written again. */
+    for (int y = ymin; y <= ymax; y++) {
+        int const row = map.index(0, y);
+        for (int cell = active_cell_scan ? map.next_active(row, row + w) : row; cell < row + w;
+             cell = active_cell_scan ? map.next_active(cell + 1, row + w) : cell + 1) {
+            int const x = cell - row;
+            /* read the element only once for the checks below; the cases use get() after changing the cell */
+            GdElementEnum const element = map.at(cell);
+
             /* if we find a scanned element, change it to the normal one, and that's all. */
             /* this is required, for example for chasing stones, which have moved, always passing slime! */
-            if (is_scanned(x, y)) {
-                unscan(x, y);
+            if (is_scanned_element(element)) {
+                set_cell(cell, GdElementEnum(gd_element_engine.pair[element]));
                 continue;
             }
 
+            GD_PROFILE_CELL_BEGIN();
             /* add the ckdelay correction value for every element seen. */
-            ckdelay_current += gd_element_properties[get(x, y)].ckdelay;
+            ckdelay_current += gd_element_engine.ckdelay[element];
 
-            switch (get(x, y)) {
+            switch (element) {
                     /*
                      *  P L A Y E R S
                      */
@@ -1845,7 +2044,7 @@ GdDirectionEnum CaveRendered::iterate(GdDirectionEnum player_move, bool player_f
                             /* and if walls reappear, remember it in array */
                             /* y+1 is down */
                             if (hammered_walls_reappear)
-                                hammered_reappear(x, (y + 1) % h) = hammered_wall_reappear_frame;
+                                add_hammered_wall(x, (y + 1) % h);
                         }
                     }
                     break;
@@ -2446,8 +2645,7 @@ GdDirectionEnum CaveRendered::iterate(GdDirectionEnum player_move, bool player_f
                             /* if no amoeba found during THIS SCAN yet, which was able to grow, check this one. */
                             if (amoeba_found_enclosed)
                                 /* if still found enclosed, check all four directions, if this one is able to grow. */
-                                if (amoeba_eats(x, y, MV_UP) || amoeba_eats(x, y, MV_DOWN)
-                                        || amoeba_eats(x, y, MV_LEFT) || amoeba_eats(x, y, MV_RIGHT)) {
+                                if (amoeba_can_grow(x, y, cell)) {
                                     amoeba_found_enclosed = false;  /* not enclosed. this is a local (per scan) flag! */
                                     amoeba_state = GD_AM_AWAKE;
                                 }
@@ -2500,8 +2698,7 @@ GdDirectionEnum CaveRendered::iterate(GdDirectionEnum player_move, bool player_f
                             case GD_AM_AWAKE:
                                 /* if no amoeba found during THIS SCAN yet, which was able to grow, check this one. */
                                 if (amoeba_2_found_enclosed)
-                                    if (amoeba_eats(x, y, MV_UP) || amoeba_eats(x, y, MV_DOWN)
-                                            || amoeba_eats(x, y, MV_LEFT) || amoeba_eats(x, y, MV_RIGHT)) {
+                                    if (amoeba_can_grow(x, y, cell)) {
                                         amoeba_2_found_enclosed = false; /* not enclosed. this is a local (per scan) flag! */
                                         amoeba_2_state = GD_AM_AWAKE;
                                     }
@@ -2935,6 +3132,8 @@ GdDirectionEnum CaveRendered::iterate(GdDirectionEnum player_move, bool player_f
 
                 default:
                     /* other inanimate elements that do nothing */
+                    if (active_cell_scan)
+                        idle_elements[element] = true;
                     break;
             }
 
@@ -2943,56 +3142,54 @@ GdDirectionEnum CaveRendered::iterate(GdDirectionEnum player_move, bool player_f
             /* and, it must be cleared, as it should not be scanned; for example, */
             /* if it is, a replicator will not replicate it! */
             unscan(x, y);
+
+            /* if the cell does nothing, it need not be visited until something is written there */
+            if (active_cell_scan && is_idle_element(map.at(cell)))
+                map.set_inactive(cell);
+            GD_PROFILE_CELL_DONE(element);
         }
+    }
+    GD_PROFILE_PHASE_DONE(PhaseScan);
 
     /* POSTPROCESSING */
 
     /* forget "scanned" flags for objects. */
     /* also, check for time penalties. */
     /* these is something like an effect table, but we do not really use one. */
-    for (int y = 0; y < h; y++)
-        for (int x = 0; x < w; x++) {
-            unscan(x, y);
-            if (get(x, y) == O_TIME_PENALTY) {
-                store(x, y, O_GRAVESTONE);
-                time_decrement_sec += time_penalty; /* there is time penalty for destroying the voodoo */
-            }
-        }
-
-    /* another scan-like routine: */
     /* short explosions (for example, in bd1) started with explode_2. */
     /* internally we use explode_1; and change it to explode_2 if needed. */
-    if (short_explosions)
-        for (int y = 0; y < h; y++)
-            for (int x = 0; x < w; x++)
-                if (is_first_stage_of_explosion(x, y)) {
-                    next(x, y); /* select next frame of explosion */
-                    unscan(x, y); /* forget scanned flag immediately */
-                }
-
-    /* this loop finds the coordinates of the player. needed for scrolling and chasing stone.*/
+    /* and find the coordinates of the player. needed for scrolling and chasing stone.*/
     /* but we only do this, if a living player was found. otherwise "stay" at current coordinates. */
-    if (player_state == GD_PL_LIVING) {
-        if (active_is_first_found) {
-            /* to be 1stb compatible, we do everything backwards. */
-            for (int y = h - 1; y >= 0; y--)
-                for (int x = w - 1; x >= 0; x--)
-                    if (is_player(x, y)) {
-                        /* here we remember the coordinates. */
-                        player_x = x;
-                        player_y = y;
-                    }
-        } else {
-            /* as in the original: look for the last one */
-            for (int y = 0; y < h; y++)
-                for (int x = 0; x < w; x++)
-                    if (is_player(x, y)) {
-                        /* here we remember the coordinates. */
-                        player_x = x;
-                        player_y = y;
-                    }
+    /* all these only read and write the cell itself, so they are done in a single pass. */
+    bool const find_player = player_state == GD_PL_LIVING;
+    bool const short_explosion_frames = short_explosions;  /* a local copy, so it is not reloaded for every cell */
+    bool player_found = false;
+    for_each_cell(0, h - 1, [&](int x, int y, int cell) {
+        GdElementEnum element = map.at(cell);
+        if (is_scanned_element(element)) {
+            element = GdElementEnum(gd_element_engine.pair[element]);
+            set_cell(cell, element);
         }
-    }
+        if (element == O_TIME_PENALTY) {
+            store(x, y, O_GRAVESTONE);
+            time_decrement_sec += time_penalty; /* there is time penalty for destroying the voodoo */
+            element = map.at(cell);
+        }
+        if (short_explosion_frames && (gd_element_engine.flags[element] & P_EXPLOSION_FIRST_STAGE) != 0) {
+            /* select next frame of explosion, and forget scanned flag immediately */
+            GdElementEnum const next_frame = GdElementEnum(element + 1);
+            element = is_scanned_element(next_frame) ? GdElementEnum(gd_element_engine.pair[next_frame]) : next_frame;
+            set_cell(cell, element);
+        }
+        /* to be 1stb compatible, the first one is remembered; as in the original, the last one otherwise. */
+        if (find_player && (gd_element_engine.flags[element] & P_PLAYER) != 0 && !(active_is_first_found && player_found)) {
+            /* here we remember the coordinates. */
+            player_x = x;
+            player_y = y;
+            player_found = true;
+        }
+    });
+
     /* record coordinates of player for chasing stone */
     for (unsigned i = 0; i < PlayerMemSize - 1; i++) {
         player_x_mem[i] = player_x_mem[i + 1];
@@ -3001,9 +3198,12 @@ GdDirectionEnum CaveRendered::iterate(GdDirectionEnum player_move, bool player_f
     player_x_mem[PlayerMemSize - 1] = player_x;
     player_y_mem[PlayerMemSize - 1] = player_y;
 
+    GD_PROFILE_PHASE_DONE(PhaseUnscan);
+
     /* SCHEDULING */
     /* updates based on the calculated explosions and per element ckdelays. */
     update_scheduling();
+    GD_PROFILE_PHASE_DONE(PhaseScheduling);
 
     /* CAVE VARIABLES */
 
@@ -3180,6 +3380,7 @@ GdDirectionEnum CaveRendered::iterate(GdDirectionEnum player_move, bool player_f
         last_horizontal_direction = MV_LEFT;
     if (player_move == MV_RIGHT || player_move == MV_UP_RIGHT || player_move == MV_DOWN_RIGHT)
         last_horizontal_direction = MV_RIGHT;
+    GD_PROFILE_PHASE_DONE(PhaseBookkeeping);
 
     // return direction of movement of player, which might be changed if no diagonal movements.
     return player_move;
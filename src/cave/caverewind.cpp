@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <algorithm>
+
+#include "misc/bytestream.hpp"
+
+#include "cave/caverewind.hpp"
+
+/*
+ * The changes between two states of the same size are stored as a list of
+ * runs: the number of unchanged bytes to skip, the number of bytes changed,
+ * then the new bytes themselves. The numbers are stored as 7-bit varints,
+ * as they are usually small.
+ */
+
+namespace {
+
+/// Runs of changed bytes are merged, if there are fewer equal bytes between
+/// them than this. Storing a few unchanged bytes is cheaper than a new run.
+const size_t merge_gap = 4;
+
+}
+
+
+RewindBuffer::RewindBuffer(size_t max_bytes, unsigned int keyframe_interval)
+    :   bytes(0),
+        max_bytes(max_bytes),
+        keyframe_interval(std::max(keyframe_interval, 1u)),
+        since_keyframe(0),
+        keyframes(0) {
+}
+
+
+/// Calculate the changes between two states of the same size.
+/// @param from The previous state.
+/// @param to The new state.
+/// @param changes The changes are stored here, to be used with apply_changes().
+void RewindBuffer::encode_changes(std::vector<unsigned char> const &from, std::vector<unsigned char> const &to, std::vector<unsigned char> &changes) {
+    size_t const size = to.size();
+    size_t pos = 0, run_end = 0;
+    changes.clear();
+    while (pos < size) {
+        /* find the next changed byte */
+        size_t start = pos;
+        while (start < size && from[start] == to[start])
+            ++start;
+        if (start == size)
+            break;
+        /* find the end of the run; short stretches of equal bytes are included */
+        size_t end = start + 1, equal = 0;
+        while (end < size && equal < merge_gap) {
+            if (from[end] == to[end])
+                ++equal;
+            else
+                equal = 0;
+            ++end;
+        }
+        end -= equal;
+        gd_put_varint(changes, start - run_end);
+        gd_put_varint(changes, end - start);
+        changes.insert(changes.end(), to.begin() + start, to.begin() + end);
+        pos = run_end = end;
+    }
+}
+
+
+/// Apply the changes calculated by encode_changes().
+/// @param state The previous state, which is changed to the new one.
+/// @param changes The changes.
+/// @return false, if the changes are invalid for this state.
+bool RewindBuffer::apply_changes(std::vector<unsigned char> &state, std::vector<unsigned char> const &changes) {
+    size_t pos = 0, statepos = 0;
+    while (pos < changes.size()) {
+        size_t skip, length;
+        if (!gd_get_varint(changes, pos, skip) || !gd_get_varint(changes, pos, length))
+            return false;
+        if (skip > state.size() - statepos || length > state.size() - statepos - skip || length > changes.size() - pos)
+            return false;
+        statepos += skip;
+        std::copy(changes.begin() + pos, changes.begin() + pos + length, state.begin() + statepos);
+        statepos += length;
+        pos += length;
+    }
+    return true;
+}
+
+
+/// Drop the oldest keyframe, and the frames which are stored as changes to it.
+void RewindBuffer::drop_oldest() {
+    do {
+        bytes -= frames.front().data.size();
+        if (frames.front().keyframe)
+            --keyframes;
+        frames.pop_front();
+    } while (!frames.empty() && !frames.front().keyframe);
+}
+
+
+/// Store the state of the next frame.
+/// If the memory limit is reached, the oldest frames are forgotten. The
+/// frames since the last keyframe are always kept, so the memory used can be
+/// larger than the limit by at most keyframe_interval frames.
+/// @param state The save state of the cave.
+/// @param tag A number to be returned by rewind() along with this state.
+void RewindBuffer::push(std::vector<unsigned char> const &state, unsigned int tag) {
+    if (max_bytes == 0)
+        return;
+
+    Frame frame;
+    frame.tag = tag;
+    if (frames.empty() || since_keyframe + 1 >= keyframe_interval || state.size() != last.size()) {
+        frame.keyframe = true;
+        frame.data = state;
+        since_keyframe = 0;
+        ++keyframes;
+    } else {
+        frame.keyframe = false;
+        encode_changes(last, state, frame.data);
+        ++since_keyframe;
+    }
+    bytes += frame.data.size();
+    frames.push_back(std::move(frame));
+    last = state;
+
+    while (bytes > max_bytes && keyframes > 1)
+        drop_oldest();
+}
+
+
+/// Go back in time.
+/// The frames after the one restored are forgotten, so it becomes the last
+/// one pushed. If not as many frames are stored, the oldest one is restored.
+/// @param count The number of frames to go back; 0 returns the last state pushed.
+/// @param state The state is stored here.
+/// @param tag The tag of the state is stored here.
+/// @return true if successful, false if the buffer is empty.
+bool RewindBuffer::rewind(unsigned int count, std::vector<unsigned char> &state, unsigned int &tag) {
+    if (frames.empty())
+        return false;
+
+    size_t target = count < frames.size() ? frames.size() - 1 - count : 0;
+    /* the first frame is always a keyframe */
+    size_t key = target;
+    while (!frames[key].keyframe)
+        --key;
+    std::vector<unsigned char> restored = frames[key].data;
+    for (size_t i = key + 1; i <= target; ++i)
+        if (!apply_changes(restored, frames[i].data))
+            return false;
+
+    tag = frames[target].tag;
+    while (frames.size() > target + 1) {
+        bytes -= frames.back().data.size();
+        if (frames.back().keyframe)
+            --keyframes;
+        frames.pop_back();
+    }
+    since_keyframe = target - key;
+    last = restored;
+    state = std::move(restored);
+    return true;
+}
+
+
+/// Forget all stored frames.
+void RewindBuffer::clear() {
+    frames.clear();
+    last.clear();
+    bytes = 0;
+    since_keyframe = 0;
+    keyframes = 0;
+}
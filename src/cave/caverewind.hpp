@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef CAVEREWIND_HPP_INCLUDED
+#define CAVEREWIND_HPP_INCLUDED
+
+#include "config.h"
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+/// @ingroup Cave
+/// Stores the save states of the last frames of a game, so it can be rewound.
+///
+/// Consecutive states differ in only a few bytes, so every state is stored as
+/// the list of bytes changed since the previous one. Every keyframe_interval
+/// frames (or if the size of the state changes) the full state is stored
+/// instead; a state is restored by applying the changes to the keyframe
+/// before it. If the buffer grows larger than its memory limit, the oldest
+/// keyframe with all the frames depending on it is dropped.
+///
+/// The states are the ones created by gd_cave_state_save(). Along with every
+/// state, a tag can be stored, for example the position in a replay.
+class RewindBuffer {
+private:
+    struct Frame {
+        bool keyframe;                      ///< true if data is a full state, false if changes
+        unsigned int tag;                   ///< stored by the caller along with the state
+        std::vector<unsigned char> data;    ///< the state, or changes to the previous frame
+    };
+    std::deque<Frame> frames;
+    std::vector<unsigned char> last;        ///< the last state pushed, to calculate the changes from
+    size_t bytes;                           ///< size of the data of the frames
+    size_t max_bytes;
+    unsigned int keyframe_interval;
+    unsigned int since_keyframe;            ///< number of frames since the last keyframe
+    unsigned int keyframes;                 ///< number of keyframes stored
+
+    void drop_oldest();
+
+public:
+    static void encode_changes(std::vector<unsigned char> const &from, std::vector<unsigned char> const &to, std::vector<unsigned char> &changes);
+    static bool apply_changes(std::vector<unsigned char> &state, std::vector<unsigned char> const &changes);
+
+    RewindBuffer(size_t max_bytes, unsigned int keyframe_interval = 50);
+
+    void push(std::vector<unsigned char> const &state, unsigned int tag);
+    bool rewind(unsigned int count, std::vector<unsigned char> &state, unsigned int &tag);
+    void clear();
+
+    /// False if the memory limit is zero, and no frames are stored at all.
+    bool enabled() const {
+        return max_bytes != 0;
+    }
+    /// Number of frames stored, including the last one pushed.
+    size_t size() const {
+        return frames.size();
+    }
+    /// Memory used by the stored frames, in bytes.
+    size_t memory() const {
+        return bytes;
+    }
+};
+
+#endif
@@ -25,6 +25,7 @@
 
 #include <glib/gi18n.h>
 
+#include <cstdint>
 #include <cstdio>
 #include <fstream>
 #include "cave/caveset.hpp"
@@ -32,6 +33,7 @@
 #include "misc/autogfreeptr.hpp"
 #include "cave/caverendered.hpp"
 #include "fileops/bdcffsave.hpp"
+#include "misc/parallel.hpp"
 
 /* list of possible extensions which can be opened */
 const char *gd_caveset_extensions[] = {"*.gds", "*.bd", "*.bdr", "*.brc", "*.vsf", "*.mem", NULL};
@@ -68,11 +70,27 @@ PropertyDescription const CaveSet::descriptor[] = {
 
 /* calculates an adler checksum, for which it uses all
    elements of all cave-rendereds. */
+/* the caves are rendered and summed on all processors. the sums of each cave
+   start from zero, and are added to the checksum of the caves before it in order:
+   after summing n cells to a and b, a grew by the sum of the cells, and b by the
+   sum of the cave plus n times a before. so the result is the same as summing
+   the caves one after the other. */
 unsigned CaveSet::checksum() const {
-    unsigned a = 1, b = 0;
-    for (unsigned int i = 0; i < caves.size(); ++i) {
+    unsigned const mod = 65521;
+    std::vector<unsigned> cave_a(caves.size()), cave_b(caves.size()), cave_cells(caves.size());
+    gd_parallel_for(caves.size(), 0, [&](unsigned i) {
         CaveRendered rendered(caves[i], 0, 0);  /* level=1, seed=0 */
+        unsigned a = 0, b = 0;
         gd_cave_adler_checksum_more(rendered, a, b);
+        cave_a[i] = a;
+        cave_b[i] = b;
+        cave_cells[i] = rendered.w * rendered.h;
+    });
+
+    unsigned a = 1, b = 0;
+    for (unsigned int i = 0; i < caves.size(); ++i) {
+        b = (b + uint64_t(cave_cells[i] % mod) * a + cave_b[i]) % mod;
+        a = (a + cave_a[i]) % mod;
     }
     return (b << 16) + a;
 }
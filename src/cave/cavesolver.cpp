@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "cave/cavestored.hpp"
+#include "cave/caverendered.hpp"
+#include "cave/elementproperties.hpp"
+#include "cave/replayverify.hpp"
+#include "misc/parallel.hpp"
+#include "misc/printf.hpp"
+#include "misc/util.hpp"
+
+#include "cave/cavesolver.hpp"
+
+
+namespace {
+
+/// A movement of the player: a direction, and whether fire is pressed.
+struct Action {
+    GdDirectionEnum move;
+    bool fire;
+};
+
+/// A state of the search: the cave after some frames, and how it was reached.
+struct Node {
+    std::unique_ptr<CaveRendered> cave;
+    uint64_t key = 0;           ///< states with the same key are considered the same, see solver_key()
+    int value = 0;              ///< estimated progress towards the exit; larger is better
+    int novelty = 0;            ///< the value, decreased for places already visited many times
+    unsigned parent = 0;        ///< index of the state in the previous frame
+    unsigned char action = 0;   ///< index of the action leading here from the parent
+};
+
+/// The way back from a state of the beam to the previous frame.
+struct Step {
+    unsigned parent;
+    unsigned char action;
+};
+
+}
+
+
+/// The movements tried in each state. Without diagonal movements allowed in
+/// the cave, diagonal directions do the same as others, so they are left out.
+static std::vector<Action> solver_actions(CaveStored const &cave) {
+    std::vector<Action> actions;
+    actions.push_back(Action{MV_STILL, false});
+    for (int dir = MV_UP; dir < MV_MAX; ++dir) {
+        if (!cave.diagonal_movements && dir != MV_UP && dir != MV_RIGHT && dir != MV_DOWN && dir != MV_LEFT)
+            continue;
+        actions.push_back(Action{GdDirectionEnum(dir), false});
+        actions.push_back(Action{GdDirectionEnum(dir), true});
+    }
+    return actions;
+}
+
+
+static bool is_outbox(GdElementEnum e) {
+    return e == O_PRE_OUTBOX || e == O_OUTBOX || e == O_PRE_INVIS_OUTBOX || e == O_INVIS_OUTBOX;
+}
+
+
+/// Find the shortest way of the player through space and dirt to the nearest
+/// diamond, or to the exit if it is already open. Falling stones, creatures
+/// and the like are not taken into account.
+/// @param cave The cave, with the player living.
+/// @param first_step If not NULL, the direction of the first step is stored here; MV_STILL if there is no way.
+/// @return The number of steps to the goal, or -1 if it cannot be reached.
+int gd_cave_path_to_goal(CaveRendered const &cave, GdDirectionEnum *first_step) {
+    /* buffers of the search, kept for each thread to avoid allocations */
+    static thread_local std::vector<int> distance;
+    static thread_local std::vector<unsigned char> first;
+    static thread_local std::vector<int> queue;
+    static GdDirectionEnum const dirs[] = { MV_UP, MV_RIGHT, MV_DOWN, MV_LEFT };
+    int const w = cave.w, h = cave.h;
+    distance.assign(w * h, -1);
+    first.resize(w * h);
+    queue.clear();
+    if (first_step)
+        *first_step = MV_STILL;
+
+    if (cave.player_x < 0 || cave.player_x >= w || cave.player_y < 0 || cave.player_y >= h)
+        return -1;
+    int start = cave.player_y * w + cave.player_x;
+    distance[start] = 0;
+    queue.push_back(start);
+    for (size_t q = 0; q < queue.size(); ++q) {
+        int cell = queue[q], x = cell % w, y = cell / w;
+        for (int d = 0; d < 4; ++d) {
+            int nx = x + gd_dx[dirs[d]], ny = y + gd_dy[dirs[d]];
+            if (nx < 0 || nx >= w || ny < 0 || ny >= h || distance[ny * w + nx] >= 0)
+                continue;
+            unsigned char step = cell == start ? d : first[cell];
+            GdElementEnum e = GdElementEnum(cave.map.row(ny)[nx]);
+            if (cave.gate_open ? is_outbox(e) : e == O_DIAMOND) {
+                if (first_step)
+                    *first_step = dirs[step];
+                return distance[cell] + 1;
+            }
+            if (e != O_SPACE && !(gd_element_engine.flags[e] & P_DIRT))
+                continue;
+            distance[ny * w + nx] = distance[cell] + 1;
+            first[ny * w + nx] = step;
+            queue.push_back(ny * w + nx);
+        }
+    }
+    return -1;
+}
+
+
+/// Estimate how near the player is to solving the cave. Diamonds collected
+/// count the most; then the length of the way to the nearest diamond, or to
+/// the exit if it is already open. If there is no way, the distance as the
+/// crow flies is used, plus a penalty.
+static int solver_value(CaveRendered const &cave) {
+    int nearest = gd_cave_path_to_goal(cave, NULL);
+    if (nearest < 0) {
+        int straight = INT_MAX;
+        for (int y = 0; y < cave.h; ++y) {
+            uint16_t const *row = cave.map.row(y);
+            for (int x = 0; x < cave.w; ++x) {
+                GdElementEnum e = GdElementEnum(row[x]);
+                if (cave.gate_open ? is_outbox(e) : e == O_DIAMOND)
+                    straight = std::min(straight, abs(x - cave.player_x) + abs(y - cave.player_y));
+            }
+        }
+        if (straight != INT_MAX)
+            nearest = straight + cave.w + cave.h;
+    }
+
+    int value = std::min<int>(cave.diamonds_collected, cave.diamonds_needed) * 1000;
+    if (cave.gate_open)
+        value += 1000000;
+    if (nearest >= 0)
+        value -= nearest * 10;
+    return value;
+}
+
+
+/// The key of a state to find the same ones. Only the position of the player
+/// and the diamonds collected are used; otherwise the beam would fill up with
+/// states which only differ in the dirt dug away, and the search would not
+/// go anywhere.
+static uint64_t solver_key(CaveRendered const &cave) {
+    return uint64_t(cave.diamonds_collected) << 40 | uint64_t(cave.gate_open) << 32
+           | uint64_t(cave.player_y & 0xffff) << 16 | uint64_t(cave.player_x & 0xffff);
+}
+
+
+/// Search for a sequence of movements which takes the player to the exit.
+/// This is a beam search over the frames of the cave: every state kept is
+/// copied and iterated once with every movement, and of all the new states,
+/// the best ones (see solver_value()) are kept for the next frame. States
+/// with the same key (see solver_key()) are kept only once. The states are
+/// expanded on a pool of worker threads; the result does not depend on the
+/// number of threads.
+/// @param cave The cave to solve.
+/// @param level The level to play, 0 is level 1.
+/// @param seed The seed to render the cave with.
+/// @param options The width of the beam etc.
+/// @return The statistics of the search, and the solution as a replay, if found.
+SolverResult gd_cave_solve(CaveStored const &cave, int level, int seed, SolverOptions const &options) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Action> const actions = solver_actions(cave);
+    unsigned const num_actions = actions.size();
+    SolverResult result;
+
+    std::vector<Node> beam(1);
+    beam[0].cave = std::make_unique<CaveRendered>(cave, level, seed);
+    beam[0].cave->setup_for_game();
+    /* nothing is drawn, so the cave can be scanned with the faster scheduler */
+    beam[0].cave->active_cell_scan = true;
+    unsigned const checksum = gd_cave_adler_checksum(*beam[0].cave);
+
+    std::vector<std::vector<Step>> history;
+    std::unordered_map<uint64_t, int> visits;  /* number of times a state was in the beam */
+    std::atomic<long long> copy_ns(0), iterate_ns(0);
+    int exit_found = -1;            /* index of a child which exited the cave */
+    std::vector<Node> children;
+    while (!beam.empty() && result.frames < options.max_frames) {
+        /* expand every state of the beam with every action */
+        children.clear();
+        children.resize(beam.size() * num_actions);
+        gd_parallel_for(beam.size(), options.threads, [&](unsigned i) {
+            CaveRendered const &parent = *beam[i].cave;
+            /* before the player is born or after dying, movements do nothing */
+            unsigned tried = parent.player_state == GD_PL_LIVING ? num_actions : 1;
+            long long copy = 0, iterate = 0;
+            for (unsigned a = 0; a < tried; ++a) {
+                auto t0 = std::chrono::steady_clock::now();
+                auto child = std::make_unique<CaveRendered>(parent);
+                auto t1 = std::chrono::steady_clock::now();
+                child->iterate(actions[a].move, actions[a].fire, false);
+                auto t2 = std::chrono::steady_clock::now();
+                copy += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+                iterate += std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+                /* nobody draws the particles, so do not let them pile up */
+                child->particles.clear();
+                if (child->player_state == GD_PL_DIED || child->player_state == GD_PL_TIMEOUT)
+                    continue;
+
+                Node &node = children[i * num_actions + a];
+                node.key = solver_key(*child);
+                node.value = child->player_state == GD_PL_EXITED ? INT_MAX : solver_value(*child);
+                node.parent = i;
+                node.action = a;
+                node.cave = std::move(child);
+            }
+            copy_ns += copy;
+            iterate_ns += iterate;
+        });
+        result.frames++;
+
+        /* select the best ones. half of the beam is chosen by the value of
+         * the states. the other half also prefers states at places visited
+         * fewer times, so the beam does not get stuck wandering around the
+         * same place. the order of the children breaks ties, so the result
+         * does not depend on the threads. */
+        std::vector<unsigned> order;
+        std::unordered_set<uint64_t> keys;
+        for (unsigned i = 0; i < children.size(); ++i)
+            if (children[i].cave) {
+                result.states++;
+                order.push_back(i);
+                keys.insert(children[i].key);
+                children[i].novelty = children[i].value;
+                auto found = visits.find(children[i].key);
+                if (found != visits.end() && children[i].value != INT_MAX)
+                    children[i].novelty -= found->second * 20;
+            }
+        result.duplicates += order.size() - keys.size();
+
+        std::unordered_set<uint64_t> seen;
+        std::vector<Node> next;
+        std::vector<Step> steps;
+        auto select = [&](int Node::*by, int limit) {
+            std::stable_sort(order.begin(), order.end(), [&children, by](unsigned a, unsigned b) {
+                return children[a].*by > children[b].*by;
+            });
+            for (unsigned i : order) {
+                if (int(next.size()) >= limit || exit_found >= 0)
+                    break;
+                if (!children[i].cave || !seen.insert(children[i].key).second)
+                    continue;
+                visits[children[i].key]++;
+                steps.push_back(Step{children[i].parent, children[i].action});
+                next.push_back(std::move(children[i]));
+                if (next.back().cave->player_state == GD_PL_EXITED)
+                    exit_found = next.size() - 1;
+            }
+        };
+        select(&Node::value, (options.beam_width + 1) / 2);
+        select(&Node::novelty, options.beam_width);
+        history.push_back(std::move(steps));
+        beam = std::move(next);
+        if (exit_found >= 0)
+            break;
+
+        if (options.progress)
+            options.progress(result.frames, beam.size(), beam.empty() ? 0 : int(beam[0].cave->diamonds_collected));
+    }
+
+    if (exit_found >= 0) {
+        /* walk back the history to get the movements */
+        std::vector<unsigned char> path(history.size());
+        unsigned index = exit_found;
+        for (size_t f = history.size(); f-- > 0;) {
+            path[f] = history[f][index].action;
+            index = history[f][index].parent;
+        }
+
+        CaveReplay &replay = result.replay;
+        replay.level = level + 1;   /* compatibility with bdcff - level=1 is written in file */
+        replay.seed = seed;
+        replay.checksum = checksum;
+        replay.recorded_with = PACKAGE_STRING;
+        replay.player_name = "Solver";
+        replay.date = gd_get_current_date_time();
+        replay.comment = Printf("Found by the cave solver, beam width %d", options.beam_width);
+        for (unsigned char a : path)
+            replay.store_movement(actions[a].move, actions[a].fire, false);
+
+        /* play it again, to get the score and duration like a game would */
+        ReplayResult played = gd_replay_play_headless(cave, replay);
+        replay.success = played.success;
+        replay.score = played.score;
+        replay.duration = played.duration;
+        replay.saved = true;
+        result.solved = played.success;
+    }
+
+    result.copy_seconds = copy_ns / 1e9;
+    result.iterate_seconds = iterate_ns / 1e9;
+    result.wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef CAVESOLVER_HPP_INCLUDED
+#define CAVESOLVER_HPP_INCLUDED
+
+#include "config.h"
+
+#include <functional>
+
+#include "cave/helper/cavereplay.hpp"
+
+class CaveStored;
+class CaveRendered;
+
+/// @ingroup Cave
+/// Parameters of the cave solver.
+struct SolverOptions {
+    int beam_width = 300;       ///< number of states kept after each frame
+    int max_frames = 20000;     ///< give up after this number of frames
+    unsigned threads = 0;       ///< number of worker threads, 0 to use all processors
+    /// If given, called after every frame searched, with the number of frames searched,
+    /// the number of states kept, and the diamonds collected in the best state.
+    std::function<void(int frames, int states, int diamonds)> progress;
+};
+
+/// @ingroup Cave
+/// The outcome of searching for a solution of a cave.
+struct SolverResult {
+    bool solved = false;        ///< true, if a way to the exit was found
+    CaveReplay replay;          ///< the solution, if found
+    int frames = 0;             ///< number of frames searched
+    long long states = 0;       ///< number of states created (copies of the cave iterated once)
+    long long duplicates = 0;   ///< number of states dropped, because another state had the same player position and diamonds
+    double copy_seconds = 0;    ///< cpu time spent on copying the caves
+    double iterate_seconds = 0; ///< cpu time spent in CaveRendered::iterate()
+    double wall_time = 0;       ///< real time spent on searching, in seconds
+};
+
+int gd_cave_path_to_goal(CaveRendered const &cave, GdDirectionEnum *first_step);
+SolverResult gd_cave_solve(CaveStored const &cave, int level, int seed, SolverOptions const &options);
+
+#endif
@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <glib.h>
+#include <algorithm>
+#include <cstdint>
+
+#include "cave/caverendered.hpp"
+#include "cave/caveset.hpp"
+#include "misc/autogfreeptr.hpp"
+#include "misc/bytestream.hpp"
+#include "settings.hpp"
+
+#include "cave/cavestate.hpp"
+
+/*
+ * The save state is a little-endian binary dump of the variables of the cave
+ * which change during the game. The other ones (names, colors, probabilities
+ * and effects...) come from rendering the cave again. The particles are not
+ * saved, as they are only for the eye.
+ *
+ *   "GDSS", version, cave index, player score, cave name, level, seed, width, height
+ *   the state variables, listed in cave_state_variables()
+ *   hammered walls: count, then x, y, frames left for each
+ *   random generators: mt[624], mti of the cave generator; c64 generator seed
+ *   map: one 16-bit element for each cell, row by row
+ */
+
+namespace {
+
+char const state_magic[4] = {'G', 'D', 'S', 'S'};
+
+/// Appends values to a save state.
+class StateWriter {
+private:
+    std::vector<unsigned char> &data;
+
+public:
+    explicit StateWriter(std::vector<unsigned char> &data) : data(data) {}
+
+    void put_magic() {
+        for (char c : state_magic)
+            data.push_back(c);
+    }
+    void put16(unsigned v) {
+        gd_put16(data, v);
+    }
+    void put32(uint32_t v) {
+        gd_put32(data, v);
+    }
+    void put_string(std::string const &s) {
+        put32(s.size());
+        data.insert(data.end(), s.begin(), s.end());
+    }
+    /// Store a variable of the cave; int, bool or enum.
+    template <typename T>
+    void var(T const &v) {
+        put32(int32_t(v));
+    }
+    /// Store a variable, which must be between min and max when loading.
+    void var_in_range(GdInt const &v, int, int) {
+        var(v);
+    }
+};
+
+/// Reads values from a save state.
+/// If there is not enough data, zeros are returned, and ok() will be false.
+class StateReader {
+private:
+    std::vector<unsigned char> const &data;
+    size_t pos = 0;
+    bool good = true;
+
+public:
+    explicit StateReader(std::vector<unsigned char> const &data) : data(data) {}
+
+    bool ok() const {
+        return good;
+    }
+    void skip(size_t bytes) {
+        if (bytes > data.size() - pos)
+            good = false;
+        else
+            pos += bytes;
+    }
+    bool get_magic() {
+        if (pos + sizeof(state_magic) > data.size() || !std::equal(state_magic, state_magic + sizeof(state_magic), data.begin() + pos)) {
+            good = false;
+            return false;
+        }
+        pos += sizeof(state_magic);
+        return true;
+    }
+    unsigned get16() {
+        unsigned v;
+        if (!gd_get16(data, pos, v)) {
+            good = false;
+            return 0;
+        }
+        return v;
+    }
+    uint32_t get32() {
+        uint32_t v;
+        if (!gd_get32(data, pos, v)) {
+            good = false;
+            return 0;
+        }
+        return v;
+    }
+    std::string get_string() {
+        uint32_t size = get32();
+        if (size > data.size() - pos) {
+            good = false;
+            return std::string();
+        }
+        std::string s(data.begin() + pos, data.begin() + pos + size);
+        pos += size;
+        return s;
+    }
+    template <typename T>
+    void var(PlainOldData<T> &v) {
+        static_cast<T &>(v) = T(int32_t(get32()));
+    }
+    void var(GdProbability &v) {
+        static_cast<int &>(v) = int32_t(get32());
+    }
+    template <typename T>
+    void var(T &v) {
+        v = T(int32_t(get32()));
+    }
+    void var_in_range(GdInt &v, int, int) {
+        var(v);
+    }
+};
+
+
+/// Checks the variables of a save state, without loading them.
+/// The engine uses directions, states and coordinates as array indices, and
+/// divides by the timing factor, so a corrupt state must not get them out of
+/// range. The types of the variables passed select the range.
+class StateChecker {
+private:
+    StateReader &in;
+    bool good = true;
+
+    void check(int min, int max) {
+        int32_t v = in.get32();
+        if (v < min || v > max)
+            good = false;
+    }
+
+public:
+    explicit StateChecker(StateReader &in) : in(in) {}
+
+    bool ok() const {
+        return good && in.ok();
+    }
+    template <typename T>
+    void var(T const &) {
+        in.get32();
+    }
+    void var(GdDirection const &) {
+        check(0, MV_MAX - 1);
+    }
+    void var(GdDirectionEnum const &) {
+        check(0, MV_MAX - 1);
+    }
+    void var(PlayerState const &) {
+        check(0, GD_PL_EXITED);
+    }
+    void var(MagicWallState const &) {
+        check(0, GD_MW_EXPIRED);
+    }
+    void var(AmoebaState const &) {
+        check(0, GD_AM_ENCLOSED);
+    }
+    void var_in_range(GdInt const &, int min, int max) {
+        check(min, max);
+    }
+};
+
+
+/// The variables of the cave, which change during the game.
+/// Listed here once for both saving and loading, so they are always in the same order.
+template <typename ARCHIVE, typename CAVE>
+void cave_state_variables(ARCHIVE &ar, CAVE &cave) {
+    /* from CaveRendered */
+    ar.var(cave.hatched);
+    ar.var(cave.gate_open);
+    ar.var_in_range(cave.timing_factor, 1, G_MAXINT);
+    ar.var(cave.speed);
+    ar.var(cave.ckdelay);
+    ar.var(cave.hatching_delay_frame);
+    ar.var(cave.hatching_delay_time);
+    ar.var(cave.time_bonus);
+    ar.var(cave.time_penalty);
+    ar.var(cave.time);
+    ar.var(cave.time_elapsed);
+    ar.var(cave.timevalue);
+    ar.var(cave.diamonds_needed);
+    ar.var(cave.diamonds_collected);
+    ar.var(cave.skeletons_collected);
+    ar.var(cave.gate_open_flash);
+    ar.var(cave.amoeba_time);
+    ar.var(cave.amoeba_2_time);
+    ar.var(cave.amoeba_max_count);
+    ar.var(cave.amoeba_2_max_count);
+    ar.var(cave.amoeba_state);
+    ar.var(cave.convert_amoeba_this_frame);
+    ar.var(cave.amoeba_2_state);
+    ar.var(cave.magic_wall_time);
+    ar.var(cave.slime_permeability);
+    ar.var(cave.slime_permeability_c64);
+    ar.var(cave.magic_wall_state);
+    ar.var(cave.player_state);
+    ar.var(cave.player_seen_ago);
+    ar.var(cave.kill_player);
+    ar.var(cave.sweet_eaten);
+    ar.var_in_range(cave.player_x, 0, cave.w - 1);
+    ar.var_in_range(cave.player_y, 0, cave.h - 1);
+    for (unsigned i = 0; i < CaveRendered::PlayerMemSize; ++i) {
+        ar.var_in_range(cave.player_x_mem[i], 0, cave.w - 1);
+        ar.var_in_range(cave.player_y_mem[i], 0, cave.h - 1);
+    }
+    ar.var(cave.key1);
+    ar.var(cave.key2);
+    ar.var(cave.key3);
+    ar.var(cave.diamond_key_collected);
+    ar.var(cave.inbox_flash_toggle);
+    ar.var(cave.biters_wait_frame);
+    ar.var(cave.replicators_wait_frame);
+    ar.var(cave.creatures_direction_will_change);
+    ar.var(cave.gravity_will_change);
+    ar.var(cave.gravity_disabled);
+    ar.var(cave.gravity_next_direction);
+    ar.var(cave.got_pneumatic_hammer);
+    ar.var(cave.pneumatic_hammer_active_delay);
+    ar.var(cave.last_direction);
+    ar.var(cave.last_horizontal_direction);
+    ar.var(cave.player_blinking);
+    ar.var(cave.player_tapping);
+    ar.var(cave.voodoo_touched);
+    ar.var(cave.score);
+    ar.var(cave.ckdelay_current);
+    ar.var(cave.ckdelay_extra_for_animation);
+
+    /* from CaveBase; the ones the engine changes */
+    ar.var(cave.diamond_value);
+    ar.var(cave.amoeba_growth_prob);
+    ar.var(cave.amoeba_2_growth_prob);
+    ar.var(cave.biter_delay_frame);
+    ar.var(cave.expanding_wall_changed);
+    ar.var(cave.replicators_active);
+    ar.var(cave.conveyor_belts_active);
+    ar.var(cave.conveyor_belts_direction_changed);
+    ar.var(cave.creatures_backwards);
+    ar.var(cave.gravity);
+    ar.var(cave.gravity_switch_active);
+}
+
+
+/// Read the header of a save state.
+bool read_header(StateReader &in, CaveStateInfo &info, int &w, int &h) {
+    if (!in.get_magic() || in.get32() != uint32_t(GD_CAVE_STATE_VERSION))
+        return false;
+    info.cave_index = int32_t(in.get32());
+    info.player_score = int32_t(in.get32());
+    info.cave_name = in.get_string();
+    info.level = int32_t(in.get32());
+    info.seed = int32_t(in.get32());
+    w = int32_t(in.get32());
+    h = int32_t(in.get32());
+    return in.ok();
+}
+
+}
+
+
+/// Save the state of a cave being played.
+/// @param cave The cave, set up for playing with setup_for_game().
+/// @param info The cave index and player score to store. The other fields are taken from the cave.
+/// @return The save state.
+std::vector<unsigned char> gd_cave_state_save(CaveRendered const &cave, CaveStateInfo const &info) {
+    std::vector<unsigned char> data;
+    data.reserve(4096 + 2 * cave.w * cave.h);
+    StateWriter out(data);
+
+    out.put_magic();
+    out.put32(GD_CAVE_STATE_VERSION);
+    out.put32(info.cave_index);
+    out.put32(info.player_score);
+    out.put_string(cave.name);
+    out.put32(cave.rendered_on);
+    out.put32(cave.render_seed);
+    out.put32(cave.w);
+    out.put32(cave.h);
+
+    cave_state_variables(out, cave);
+
+    out.put32(cave.hammered_walls.size());
+    for (HammeredWall const &wall : cave.hammered_walls) {
+        out.put32(wall.x);
+        out.put32(wall.y);
+        out.put32(wall.frames_left);
+    }
+
+    RandomGenerator::State const &random = cave.random.get_state();
+    for (guint32 v : random.mt)
+        out.put32(v);
+    out.put32(random.mti);
+    out.put32(cave.c64_rand.get_seed());
+
+    for (int y = 0; y < cave.h; y++)
+        for (int x = 0; x < cave.w; x++)
+            out.put16(cave.map(x, y));
+
+    return data;
+}
+
+
+/// Read the information about the cave of a save state.
+/// @return false, if the data is not a save state of the current version.
+bool gd_cave_state_info(std::vector<unsigned char> const &data, CaveStateInfo &info) {
+    StateReader in(data);
+    int w, h;
+    return read_header(in, info, w, h);
+}
+
+
+/// Load a save state to a cave.
+/// The cave must be rendered from the same stored cave, at the level and with the
+/// seed of the state (see gd_cave_state_info()), and set up with setup_for_game().
+/// @return true, if successful. If false, the cave is unchanged.
+bool gd_cave_state_load(CaveRendered &cave, std::vector<unsigned char> const &data) {
+    StateReader in(data);
+    CaveStateInfo info;
+    int w, h;
+    if (!read_header(in, info, w, h))
+        return false;
+    if (info.cave_name != cave.name || info.level != cave.rendered_on || info.seed != cave.render_seed
+            || w != cave.w || h != cave.h)
+        return false;
+
+    /* check everything first, so the cave is not changed if the state is corrupt */
+    StateReader check(in);
+    StateChecker checker(check);
+    cave_state_variables(checker, cave);
+    unsigned const walls = check.get32();
+    if (!checker.ok() || walls > unsigned(w * h))
+        return false;
+    for (unsigned i = 0; i < walls; ++i) {
+        int32_t x = check.get32(), y = check.get32(), frames_left = check.get32();
+        if (x < 0 || x >= w || y < 0 || y >= h || frames_left <= 0)
+            return false;
+    }
+    check.skip(sizeof(RandomGenerator::State::mt));
+    if (check.get32() > sizeof(RandomGenerator::State::mt) / sizeof(guint32))      /* mti */
+        return false;
+    check.get32();      /* c64 random seed */
+    for (int i = 0; i < w * h; ++i)
+        if (check.get16() >= O_MAX)
+            return false;
+    if (!check.ok())
+        return false;
+
+    /* now load */
+    cave_state_variables(in, cave);
+    in.get32();
+    cave.hammered_walls.resize(walls);
+    for (HammeredWall &wall : cave.hammered_walls) {
+        wall.x = int32_t(in.get32());
+        wall.y = int32_t(in.get32());
+        wall.frames_left = int32_t(in.get32());
+    }
+
+    RandomGenerator::State random;
+    for (guint32 &v : random.mt)
+        v = in.get32();
+    random.mti = in.get32();
+    int c64_seed = in.get32();
+
+    cave.random.set_state(random);
+    cave.c64_rand.set_seed(c64_seed);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+            cave.map.set(x, y, GdElementEnum(in.get16()));
+    cave.index_teleporters();
+    cave.index_amoeba_food();
+    cave.clear_sounds();
+    cave.particles.clear();
+    return true;
+}
+
+
+/// Name of the file for a save state slot of a caveset, in the user config directory.
+/// @param caveset The caveset.
+/// @param checksum The checksum of the caveset, see CaveSet::checksum().
+/// @param slot The number of the slot.
+std::string gd_cave_state_filename(CaveSet const &caveset, unsigned checksum, int slot) {
+    AutoGFreePtr<char> canon(g_strdup(caveset.name == "" ? "state-" : caveset.name.c_str()));
+    /* allowed chars in the file name; others are replaced with _ */
+    g_strcanon(canon, "abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ", '_');
+    AutoGFreePtr<char> fname(g_strdup_printf("%08x-%s-%d.state", checksum, (char *) canon, slot));
+    AutoGFreePtr<char> path(g_build_path(G_DIR_SEPARATOR_S, gd_user_config_dir.c_str(), (char *) fname, NULL));
+    return (char *) path;
+}
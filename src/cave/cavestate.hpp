@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef CAVESTATE_HPP_INCLUDED
+#define CAVESTATE_HPP_INCLUDED
+
+#include "config.h"
+
+#include <string>
+#include <vector>
+
+class CaveRendered;
+class CaveSet;
+
+/// Version of the save state format. Must be increased whenever the
+/// data stored changes; states of other versions are not loaded.
+enum { GD_CAVE_STATE_VERSION = 2 };
+
+/// @ingroup Cave
+/// Identifies the cave a save state belongs to, and the game it was saved in.
+/// A state can only be loaded into a CaveRendered of the same cave, rendered
+/// at the same level with the same seed, and set up for playing.
+struct CaveStateInfo {
+    int cave_index = -1;        ///< index of the cave in the caveset, -1 if not known
+    int player_score = 0;       ///< score of the player in the game, without the cave
+    std::string cave_name;      ///< name of the cave. Set by gd_cave_state_save().
+    int level = 0;              ///< level the cave is rendered at. Set by gd_cave_state_save().
+    int seed = 0;               ///< render seed of the cave. Set by gd_cave_state_save().
+};
+
+std::vector<unsigned char> gd_cave_state_save(CaveRendered const &cave, CaveStateInfo const &info);
+bool gd_cave_state_info(std::vector<unsigned char> const &data, CaveStateInfo &info);
+bool gd_cave_state_load(CaveRendered &cave, std::vector<unsigned char> const &data);
+
+std::string gd_cave_state_filename(CaveSet const &caveset, unsigned checksum, int slot);
+
+#endif
@@ -317,6 +317,12 @@ void gd_cave_types_init() {
         if (gd_element_properties[i].flags & P_CAN_BE_HAMMERED)
             g_assert(gd_element_get_hammered(GdElementEnum(i)) != O_NONE);
 
+        /* copy the properties needed by the engine to the packed table */
+        g_assert(gd_element_properties[i].ckdelay >= 0 && gd_element_properties[i].ckdelay <= UINT16_MAX);
+        gd_element_engine.flags[i] = gd_element_properties[i].flags;
+        gd_element_engine.pair[i] = gd_element_properties[i].pair;
+        gd_element_engine.ckdelay[i] = gd_element_properties[i].ckdelay;
+
         /* if its pair is not the same as itself, it is a scanned pair. */
         if (gd_element_properties[i].pair != i) {
             /* check if it has correct scanned pair, a->b, b->a */
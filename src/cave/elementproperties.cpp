@@ -903,6 +903,10 @@ GdElementPorperty gd_element_properties[] = {
     {O_MAX_INDEX},
 };
 
+/* the packed engine properties of the elements; filled by gd_cave_types_init(). */
+GdElementEngineProperties gd_element_engine;
+
+
 /* return new element, which appears after elem is hammered. */
 /* returns o_none, if elem is invalid for hammering. */
 GdElementEnum
@@ -26,6 +26,8 @@
 
 #include "config.h"
 
+#include <cstdint>
+
 #include "cavetypes.hpp"
 
 /// This enum lists some properties of elements, which are used by the engine.
@@ -110,25 +112,39 @@ struct GdElementPorperty {
 extern GdElementPorperty gd_element_properties[];
 
 
+/// The properties of the elements which the game engine needs, packed.
+/// The engine looks these up for almost every cell it visits, so they are
+/// stored in separate, small arrays, instead of the large GdElementPorperty
+/// structs with names and images. Filled by gd_cave_types_init() from
+/// gd_element_properties.
+struct GdElementEngineProperties {
+    uint32_t flags[O_MAX_INDEX];    ///< flags for the engine, like P_SLOPED or P_EXPLODES
+    uint16_t pair[O_MAX_INDEX];     ///< the scanned/not scanned pair
+    uint16_t ckdelay[O_MAX_INDEX];  ///< ckdelay ratio in microseconds
+};
+
+extern GdElementEngineProperties gd_element_engine;
+
+
 /// returns true, if the given element is scanned
 inline bool is_scanned_element(GdElementEnum e) {
-    return (gd_element_properties[e].flags & P_SCANNED) != 0;
+    return (gd_element_engine.flags[e] & P_SCANNED) != 0;
 }
 
 
 /// This function converts an element to its scanned pair.
 inline GdElementEnum scanned_pair(GdElementEnum of_what) {
-    if (gd_element_properties[of_what].flags & P_SCANNED) // already scanned?
+    if (gd_element_engine.flags[of_what] & P_SCANNED) // already scanned?
         return of_what;
-    return gd_element_properties[of_what].pair;
+    return GdElementEnum(gd_element_engine.pair[of_what]);
 }
 
 
 /// This function converts an element to its scanned pair.
 inline GdElementEnum nonscanned_pair(GdElementEnum of_what) {
-    if (!(gd_element_properties[of_what].flags & P_SCANNED)) // already nonscanned?
+    if (!(gd_element_engine.flags[of_what] & P_SCANNED)) // already nonscanned?
         return of_what;
-    return gd_element_properties[of_what].pair;
+    return GdElementEnum(gd_element_engine.pair[of_what]);
 }
 
 
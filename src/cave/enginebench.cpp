@@ -0,0 +1,631 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <glib.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <sstream>
+
+#include "cave/caveset.hpp"
+#include "cave/caverendered.hpp"
+#include "cave/cavestored.hpp"
+#include "cave/engineprofile.hpp"
+#include "cave/particle.hpp"
+#include "cave/simulationbatch.hpp"
+#include "fileops/loadfile.hpp"
+#include "misc/logger.hpp"
+#include "misc/parallel.hpp"
+#include "misc/printf.hpp"
+#include "misc/util.hpp"
+
+#include "cave/enginebench.hpp"
+
+
+/// The result of playing one cave on one level.
+struct BenchRun {
+    std::string caveset;
+    std::string cave;
+    int level;
+    GdScheduling scheduling;
+    int w, h;
+    int frames;
+    double seconds;
+    long peak_rss_kb;           ///< Peak resident set size of the process, or -1 if not known.
+#ifdef GD_ENGINE_PROFILE
+    std::string hottest;        ///< The element the scan spent the most time on.
+#endif
+};
+
+/// Sums of several runs.
+struct BenchTotal {
+    int runs = 0;
+    long long frames = 0;
+    double cells = 0;           ///< Number of cells processed: frames*width*height.
+    double seconds = 0;
+    long peak_rss_kb = -1;
+
+    void add(BenchRun const &run) {
+        runs += 1;
+        frames += run.frames;
+        cells += double(run.frames) * run.w * run.h;
+        seconds += run.seconds;
+        peak_rss_kb = std::max(peak_rss_kb, run.peak_rss_kb);
+    }
+    double fps() const {
+        return seconds > 0 ? frames / seconds : 0;
+    }
+    double ns_per_cell() const {
+        return cells > 0 ? seconds * 1e9 / cells : 0;
+    }
+};
+
+
+/// Reset the peak resident set size counter of the kernel, so the
+/// next peak_rss_kb() call returns the peak since now.
+/// Only implemented on Linux; elsewhere it does nothing.
+static void peak_rss_reset() {
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f != NULL) {
+        fputs("5", f);
+        fclose(f);
+    }
+#endif
+}
+
+
+/// Get the peak resident set size of the process in kilobytes.
+/// @return The peak, or -1 if it cannot be determined on this system.
+static long peak_rss_kb() {
+    long kb = -1;
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f != NULL) {
+        char line[256];
+        while (fgets(line, sizeof(line), f) != NULL)
+            if (strncmp(line, "VmHWM:", 6) == 0)
+                kb = strtol(line + 6, NULL, 10);
+        fclose(f);
+    }
+#endif
+    return kb;
+}
+
+
+/// The identifier of the scheduling, as written in BDCFF files.
+static std::string scheduling_id(GdScheduling const &scheduling) {
+    std::ostringstream os;
+    os << scheduling;
+    return os.str();
+}
+
+
+/// Quote a string for a JSON file.
+static std::string json_quote(std::string const &s) {
+    std::string quoted = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (c < 0x20)
+            quoted += Printf("\\u%04x", unsigned(c));
+        else
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+
+/// Play a cave for the given number of frames, and measure the time.
+/// The movements of the player are given by ScriptedInput, so the numbers
+/// of different builds are comparable.
+static BenchRun bench_cave(CaveSet const &caveset, CaveStored const &cave, int level, int frames) {
+    peak_rss_reset();
+#ifdef GD_ENGINE_PROFILE
+    /* profile this cave separately, but keep the totals */
+    EngineProfile saved_profile = gd_engine_profile();
+    gd_engine_profile().clear();
+#endif
+    CaveRendered rendered(cave, level, 0);
+    rendered.setup_for_game();
+    ScriptedInput input;
+
+    std::chrono::steady_clock::duration elapsed(0);
+    for (int i = 0; i < frames; ++i) {
+        GdDirectionEnum player_move;
+        bool fire;
+        input.next(player_move, fire);
+
+        auto start = std::chrono::steady_clock::now();
+        rendered.iterate(player_move, fire, false);
+        elapsed += std::chrono::steady_clock::now() - start;
+        /* nobody draws the particles, so do not let them pile up */
+        rendered.particles.clear();
+    }
+
+    BenchRun run;
+    run.caveset = caveset.filename;
+    run.cave = cave.name;
+    run.level = level;
+    run.scheduling = cave.scheduling;
+    run.w = rendered.w;
+    run.h = rendered.h;
+    run.frames = frames;
+    run.seconds = std::chrono::duration<double>(elapsed).count();
+    run.peak_rss_kb = peak_rss_kb();
+#ifdef GD_ENGINE_PROFILE
+    run.hottest = gd_engine_profile().hottest_element();
+    saved_profile.add(gd_engine_profile());
+    gd_engine_profile() = saved_profile;
+#endif
+    return run;
+}
+
+
+static void print_text(std::vector<BenchRun> const &runs, std::map<GdSchedulingEnum, BenchTotal> const &engines, BenchTotal const &total) {
+    for (auto const &run : runs) {
+        BenchTotal one;
+        one.add(run);
+        g_print("%s", Printf("%s, %s, level %d: %d frames, %.0f frames/s, %.2f ns/cell, peak RSS %d kB",
+                             run.caveset, run.cave, run.level + 1, run.frames, one.fps(), one.ns_per_cell(), run.peak_rss_kb).c_str());
+#ifdef GD_ENGINE_PROFILE
+        g_print("%s", Printf(", hottest element %s", run.hottest).c_str());
+#endif
+        g_print("\n");
+    }
+    for (auto const &engine : engines)
+        g_print("%s", Printf("%s: %d runs, %d frames, %.0f frames/s, %.2f ns/cell, peak RSS %d kB\n",
+                             visible_name(engine.first), engine.second.runs, engine.second.frames,
+                             engine.second.fps(), engine.second.ns_per_cell(), engine.second.peak_rss_kb).c_str());
+    g_print("%s", Printf("%d runs, %d frames in %.3f s, %.0f frames/s, %.2f ns/cell, peak RSS %d kB\n",
+                         total.runs, total.frames, total.seconds, total.fps(), total.ns_per_cell(), total.peak_rss_kb).c_str());
+}
+
+
+static void print_csv(std::vector<BenchRun> const &runs, std::map<GdSchedulingEnum, BenchTotal> const &engines, BenchTotal const &total) {
+    g_print("kind,caveset,cave,level,engine,width,height,runs,frames,seconds,fps,ns_per_cell,peak_rss_kb\n");
+    for (auto const &run : runs) {
+        BenchTotal one;
+        one.add(run);
+        g_print("%s", Printf("cave,%s,%s,%d,%s,%d,%d,1,%d,%.6f,%.1f,%.3f,%d\n",
+                             gd_csv_quote(run.caveset), gd_csv_quote(run.cave), run.level + 1, scheduling_id(run.scheduling),
+                             run.w, run.h, run.frames, run.seconds, one.fps(), one.ns_per_cell(), run.peak_rss_kb).c_str());
+    }
+    for (auto const &engine : engines)
+        g_print("%s", Printf("engine,,,,%s,,,%d,%d,%.6f,%.1f,%.3f,%d\n",
+                             scheduling_id(engine.first), engine.second.runs, engine.second.frames, engine.second.seconds,
+                             engine.second.fps(), engine.second.ns_per_cell(), engine.second.peak_rss_kb).c_str());
+    g_print("%s", Printf("total,,,,,,,%d,%d,%.6f,%.1f,%.3f,%d\n",
+                         total.runs, total.frames, total.seconds, total.fps(), total.ns_per_cell(), total.peak_rss_kb).c_str());
+}
+
+
+static std::string json_total(BenchTotal const &total) {
+    return Printf("\"runs\": %d, \"frames\": %d, \"seconds\": %.6f, \"fps\": %.1f, \"ns_per_cell\": %.3f, \"peak_rss_kb\": %d",
+                  total.runs, total.frames, total.seconds, total.fps(), total.ns_per_cell(), total.peak_rss_kb);
+}
+
+
+static void print_json(std::vector<BenchRun> const &runs, std::map<GdSchedulingEnum, BenchTotal> const &engines, BenchTotal const &total) {
+    g_print("{\n  \"caves\": [\n");
+    for (size_t i = 0; i < runs.size(); ++i) {
+        BenchRun const &run = runs[i];
+        BenchTotal one;
+        one.add(run);
+        g_print("%s", Printf("    {\"caveset\": %s, \"cave\": %s, \"level\": %d, \"engine\": %s, \"width\": %d, \"height\": %d, %s}%s\n",
+                             json_quote(run.caveset), json_quote(run.cave), run.level + 1, json_quote(scheduling_id(run.scheduling)),
+                             run.w, run.h, json_total(one), i + 1 < runs.size() ? "," : "").c_str());
+    }
+    g_print("  ],\n  \"engines\": [\n");
+    size_t i = 0;
+    for (auto const &engine : engines) {
+        ++i;
+        g_print("%s", Printf("    {\"engine\": %s, %s}%s\n",
+                             json_quote(scheduling_id(engine.first)), json_total(engine.second), i < engines.size() ? "," : "").c_str());
+    }
+    g_print("  ],\n");
+    g_print("%s", Printf("  \"total\": {%s}\n}\n", json_total(total)).c_str());
+}
+
+
+/// Parse the name of a benchmark output format.
+/// @param str The name: "text", "csv" or "json".
+/// @param format The format is stored here, if the name is valid.
+/// @return True, if the name is valid.
+bool gd_bench_format_from_string(const char *str, GdBenchFormat &format) {
+    if (g_str_equal(str, "text"))
+        format = GD_BENCH_FORMAT_TEXT;
+    else if (g_str_equal(str, "csv"))
+        format = GD_BENCH_FORMAT_CSV;
+    else if (g_str_equal(str, "json"))
+        format = GD_BENCH_FORMAT_JSON;
+    else
+        return false;
+    return true;
+}
+
+
+/// Measure the speed of the game engine.
+/// Every cave is rendered on every level, and played for the given number of
+/// frames with random movements of the player. Caves which do not have different
+/// levels are only played on the first one, as the others would give the same result.
+/// Only the time spent in CaveRendered::iterate() is measured. Results are
+/// reported for every cave, summed for every engine (scheduling type), and overall.
+/// @param cavesets The cavesets to play the caves of.
+/// @param frames The number of frames to play each cave for.
+/// @param format The format of the report printed to the standard output.
+void gd_benchmark_engine(std::vector<CaveSet> const &cavesets, int frames, GdBenchFormat format) {
+    std::vector<BenchRun> runs;
+    std::map<GdSchedulingEnum, BenchTotal> engines;
+    BenchTotal total;
+
+    for (auto const &caveset : cavesets) {
+        for (auto const &cave : caveset.caves) {
+            int levels = cave.has_levels() ? 5 : 1;
+            for (int level = 0; level < levels; ++level) {
+                runs.push_back(bench_cave(caveset, cave, level, frames));
+                engines[cave.scheduling].add(runs.back());
+                total.add(runs.back());
+            }
+        }
+    }
+
+    switch (format) {
+        case GD_BENCH_FORMAT_TEXT:
+            print_text(runs, engines, total);
+            break;
+        case GD_BENCH_FORMAT_CSV:
+            print_csv(runs, engines, total);
+            break;
+        case GD_BENCH_FORMAT_JSON:
+            print_json(runs, engines, total);
+            break;
+    }
+}
+
+
+/// Number of bytes allocated on the heap, or -1 if not known.
+static long long heap_bytes_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;     /* hblkhd: large blocks allocated by mmap */
+#else
+    return -1;
+#endif
+}
+
+
+/// Stress test of the particle effects: spawn the given number of explosions
+/// in a cave, a few of them in every frame, as a long chain reaction would.
+/// Measures the time to create the particles and to move them, and counts
+/// the allocations of memory while doing so.
+void gd_benchmark_particles(int explosions) {
+    int const explosions_per_frame = 8;
+    int const frame_ms = 20;
+    int const cell_size = 32;
+    int const cave_w = 40, cave_h = 22;
+
+    ParticlePool pool;
+    RandomGenerator random(0);
+    std::chrono::steady_clock::duration spawn_time(0), update_time(0);
+    long long particles_spawned = 0, particles_moved = 0;
+    size_t peak_particles = 0;
+    int frames = 0, spawned = 0;
+    long long heap_before = heap_bytes_in_use();
+    long long heap_after_first = -1;
+
+    /* spawn all explosions, then let the particles expire */
+    while (spawned < explosions || !pool.empty()) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < explosions_per_frame && spawned < explosions; ++i, ++spawned) {
+            int x = random.rand_int_range(0, cave_w), y = random.rand_int_range(0, cave_h);
+            /* the same particles as in CaveRendered::add_particle_set for O_EXPLODE_1 */
+            pool.add(300, 0.05, 0.5, x + 0.5, y + 0.5, 1.0, 1.0, 0, 0, 4, 4, GdColor::from_rgb(255, 255, 255));
+            particles_spawned += 300;
+        }
+        auto spawned_at = std::chrono::steady_clock::now();
+        pool.normalize(cell_size);
+        pool.move(frame_ms);
+        auto moved_at = std::chrono::steady_clock::now();
+        spawn_time += spawned_at - start;
+        update_time += moved_at - spawned_at;
+        particles_moved += pool.num_particles();
+        peak_particles = std::max(peak_particles, pool.num_particles());
+        if (frames == 0)
+            heap_after_first = heap_bytes_in_use();
+        ++frames;
+    }
+    long long heap_after = heap_bytes_in_use();
+
+    double spawn_s = std::chrono::duration<double>(spawn_time).count();
+    double update_s = std::chrono::duration<double>(update_time).count();
+    g_print("%s", Printf("Particles: %d explosions, %d frames of %d ms, %d particles spawned\n", explosions, frames, frame_ms, particles_spawned).c_str());
+    g_print("%s", Printf("  peak %d particles alive (capacity %d), %d sets dropped for want of room\n", peak_particles, int(ParticlePool::MaxParticles), pool.dropped()).c_str());
+    g_print("%s", Printf("  spawn:  %.3f s, %.1f ns/particle\n", spawn_s, particles_spawned > 0 ? spawn_s * 1e9 / particles_spawned : 0.0).c_str());
+    g_print("%s", Printf("  update: %.3f s, %.1f us/frame, %.2f ns/particle\n", update_s, frames > 0 ? update_s * 1e6 / frames : 0.0, particles_moved > 0 ? update_s * 1e9 / particles_moved : 0.0).c_str());
+    g_print("%s", Printf("  pool allocations: %d\n", pool.allocations()).c_str());
+    if (heap_before >= 0)
+        g_print("%s", Printf("  heap growth: %d bytes in the first frame, %d bytes after it\n", heap_after_first - heap_before, heap_after - heap_after_first).c_str());
+}
+
+
+/// Measure the cost of rendering a frame of the game against the size of the cave.
+/// Random caves of growing size are played with scripted movements, and in every frame
+/// the cave is rendered to a gfx buffer with CaveRendered::draw_indexes(), and the
+/// buffer is walked for the cells to be redrawn, like GameRenderer::drawcave() does.
+/// This is done once for the whole cave, as the game did before, and once for the
+/// cells on the screen only. The iteration of the cave is not measured. No screen is
+/// needed, so blitting the cells is not included; that is the same in both cases, as
+/// only cells on the screen can be blitted.
+/// @param frames The number of frames to play in each cave.
+void gd_benchmark_render(int frames) {
+    /* the play area of the original game, with the margin GameRenderer uses */
+    int const screen_w = 20 + 2 * 2, screen_h = 12 + 2 * 2;
+    int const sizes[][2] = { {40, 22}, {100, 100}, {200, 200}, {400, 400}, {1000, 1000} };
+
+    g_print("%s", Printf("Rendering: %d frames per cave, screen of %dx%d cells\n", frames, screen_w, screen_h).c_str());
+    for (auto const &size : sizes) {
+        CaveStored stored;
+        stored.w = size[0];
+        stored.h = size[1];
+        stored.x1 = 0;
+        stored.y1 = 0;
+        stored.x2 = stored.w - 1;
+        stored.y2 = stored.h - 1;
+        stored.initial_fill = O_DIRT;
+        stored.random_fill_1 = O_SPACE;
+        stored.random_fill_probability_1 = 100;
+        stored.random_fill_2 = O_STONE;
+        stored.random_fill_probability_2 = 60;
+        stored.random_fill_3 = O_DIAMOND;
+        stored.random_fill_probability_3 = 20;
+        stored.random_fill_4 = O_FIREFLY_1;
+        stored.random_fill_probability_4 = 3;
+        CaveRendered const start(stored, 0, 0);
+
+        /* the screen is in the middle of the cave */
+        CellRect const whole = { start.x1, start.y1, start.x2, start.y2 };
+        CellRect screen;
+        screen.x1 = std::max<int>(start.x1, (start.x1 + start.x2 - screen_w) / 2);
+        screen.y1 = std::max<int>(start.y1, (start.y1 + start.y2 - screen_h) / 2);
+        screen.x2 = std::min<int>(start.x2, screen.x1 + screen_w - 1);
+        screen.y2 = std::min<int>(start.y2, screen.y1 + screen_h - 1);
+
+        double seconds[2];
+        long long redrawn[2];
+        for (int i = 0; i < 2; ++i) {
+            CellRect const &area = i == 0 ? whole : screen;
+            CaveRendered rendered(start);
+            CaveMap<int> gfx_buffer(rendered.w, rendered.h, -1);
+            CaveMap<bool> covered(rendered.w, rendered.h, false);
+            ScriptedInput input;
+            std::chrono::steady_clock::duration time(0);
+            redrawn[i] = 0;
+            for (int frame = 0; frame < frames; ++frame) {
+                GdDirectionEnum move;
+                bool fire;
+                input.next(move, fire);
+                rendered.iterate(move, fire, false);
+
+                auto begin = std::chrono::steady_clock::now();
+                rendered.draw_indexes(gfx_buffer, covered, false, frame % 8, false, area);
+                for (int y = area.y1; y <= area.y2; y++)
+                    for (int x = area.x1; x <= area.x2; x++)
+                        if (gfx_buffer(x, y) & GD_REDRAW) {
+                            gfx_buffer(x, y) &= ~GD_REDRAW;
+                            redrawn[i]++;
+                        }
+                time += std::chrono::steady_clock::now() - begin;
+            }
+            seconds[i] = std::chrono::duration<double>(time).count();
+        }
+
+        double const whole_us = seconds[0] * 1e6 / frames, screen_us = seconds[1] * 1e6 / frames;
+        g_print("%s", Printf("  %4dx%-4d whole cave: %9.1f us/frame, %7d cells redrawn/frame;  on screen: %6.1f us/frame, %4d cells redrawn/frame;  %.1fx\n",
+                             size[0], size[1], whole_us, int(redrawn[0] / frames), screen_us, int(redrawn[1] / frames),
+                             screen_us > 0 ? whole_us / screen_us : 0.0).c_str());
+    }
+}
+
+
+/// Measure the speed of loading cavesets. The files are read to memory first,
+/// then every one of them is parsed the given number of times with create_from_buffer(),
+/// so the disk is not measured, only the parsers. BDCFF files are also reported
+/// separately, as they are parsed as text and are the bulk of the caves.
+/// The number of memory allocations is only known in builds with GD_ENGINE_PROFILE.
+/// @param files The names of the files to load.
+/// @param repeats How many times to parse every file.
+void gd_benchmark_loader(std::vector<std::string> const &files, int repeats) {
+    struct LoaderResult {
+        int files = 0;
+        long long bytes = 0;
+        std::chrono::steady_clock::duration time = std::chrono::steady_clock::duration(0);
+        unsigned long long allocations = 0;
+    };
+    LoaderResult all, bdcff;
+    int caves = 0, failed = 0;
+    /* the messages would be the same in every run, so they are not shown */
+    Logger quiet(true);
+
+    for (auto const &filename : files) {
+        std::vector<unsigned char> contents;
+        try {
+            contents = load_file_to_vector(filename.c_str());
+        } catch (std::exception &e) {
+            failed++;
+            continue;
+        }
+        bool is_bdcff = g_str_has_suffix(filename.c_str(), ".bd") || g_str_has_suffix(filename.c_str(), ".BD");
+        LoaderResult one;
+        one.files = 1;
+        one.bytes = (contents.size() - 1) * repeats;     /* -1: the terminating zero */
+        try {
+            for (int i = 0; i < repeats; ++i) {
+#ifdef GD_ENGINE_PROFILE
+                uint64_t allocations_before = gd_engine_profile_allocations();
+#endif
+                auto start = std::chrono::steady_clock::now();
+                CaveSet caveset = create_from_buffer(&contents[0], contents.size() - 1, filename.c_str());
+                one.time += std::chrono::steady_clock::now() - start;
+#ifdef GD_ENGINE_PROFILE
+                one.allocations += gd_engine_profile_allocations() - allocations_before;
+#endif
+                if (i == 0)
+                    caves += caveset.caves.size();
+            }
+        } catch (std::exception &e) {
+            failed++;
+            continue;
+        }
+        for (LoaderResult *result : { &all, &bdcff }) {
+            if (result == &bdcff && !is_bdcff)
+                continue;
+            result->files += one.files;
+            result->bytes += one.bytes;
+            result->time += one.time;
+            result->allocations += one.allocations;
+        }
+    }
+
+    g_print("%s", Printf("Loading: %d files, %d caves, %d files failed to load, parsed %d times each\n", all.files, caves, failed, repeats).c_str());
+    for (LoaderResult const *result : { &all, &bdcff }) {
+        double const s = std::chrono::duration<double>(result->time).count();
+        double const mib = result->bytes / double(1 << 20);
+        std::string line = Printf("  %s %4d files, %.2f MiB: %.3f s, %.1f MiB/s, %.1f us/file",
+                                  result == &all ? "all:  " : "BDCFF:", result->files, mib / repeats, s,
+                                  s > 0 ? mib / s : 0.0, result->files > 0 ? s * 1e6 / result->files / repeats : 0.0);
+#ifdef GD_ENGINE_PROFILE
+        line += Printf(", %.0f allocations/file", result->files > 0 ? double(result->allocations) / result->files / repeats : 0.0);
+#endif
+        g_print("%s\n", line.c_str());
+    }
+#ifndef GD_ENGINE_PROFILE
+    g_print("  allocations are only counted in builds with GD_ENGINE_PROFILE\n");
+#endif
+}
+
+
+/// The result of a game played by gd_benchmark_batch(), to check that
+/// the two ways of playing give the same games.
+struct BatchGame {
+    int frames = 0;
+    unsigned checksum = 0;
+
+    bool operator!=(BatchGame const &other) const {
+        return frames != other.frames || checksum != other.checksum;
+    }
+};
+
+
+/// Measure the throughput of SimulationBatch on many short games.
+/// Every cave is played on every level the given number of times, from the
+/// same starting state, with different random movements, until the player
+/// exits or dies, or for at most 1000 frames. The games are played twice:
+/// first one by one, rendering a new cave for every game, then as a batch.
+/// The final states of the two must be the same.
+/// @param cavesets The cavesets to play the caves of.
+/// @param games The number of games to play on each level of each cave.
+/// @param threads The number of worker threads, 0 to use all processors.
+/// @return true, if the two ways gave the same games.
+bool gd_benchmark_batch(std::vector<CaveSet> const &cavesets, int games, unsigned threads) {
+    int const max_frames = 1000;
+    std::vector<SimulationJob> jobs;
+    for (auto const &caveset : cavesets) {
+        for (auto const &cave : caveset.caves) {
+            int levels = cave.has_levels() ? 5 : 1;
+            for (int level = 0; level < levels; ++level) {
+                for (int game = 0; game < games; ++game) {
+                    SimulationJob job;
+                    job.cave = &cave;
+                    job.level = level;
+                    job.max_frames = max_frames;
+                    ScriptedInput input(game);
+                    job.input = [input](CaveRendered const &, GdDirectionEnum &move, bool &fire) mutable {
+                        input.next(move, fire);
+                        return true;
+                    };
+                    jobs.push_back(std::move(job));
+                }
+            }
+        }
+    }
+
+    /* one by one, as done before the batch existed */
+    std::vector<BatchGame> single(jobs.size());
+    std::atomic<long long> single_frames(0);
+    auto start = std::chrono::steady_clock::now();
+    gd_parallel_for(jobs.size(), threads, [&](unsigned i) {
+        SimulationJob job = jobs[i];
+        CaveRendered rendered(*job.cave, job.level, job.seed);
+        rendered.setup_for_game();
+        rendered.active_cell_scan = true;
+        int frame = 0;
+        while (frame < job.max_frames && rendered.player_state != GD_PL_EXITED && rendered.player_state != GD_PL_TIMEOUT && rendered.player_state != GD_PL_DIED) {
+            GdDirectionEnum move = MV_STILL;
+            bool fire = false;
+            job.input(rendered, move, fire);
+            rendered.iterate(move, fire, false);
+            rendered.particles.clear();
+            ++frame;
+        }
+        single[i].frames = frame;
+        single[i].checksum = gd_cave_adler_checksum(rendered);
+        single_frames += frame;
+    });
+    double single_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    /* the same games as a batch */
+    std::vector<BatchGame> batched(jobs.size());
+    SimulationBatch batch(threads);
+    for (unsigned i = 0; i < jobs.size(); ++i) {
+        jobs[i].finished = [&batched, i](CaveRendered const &cave, int frames) {
+            batched[i].frames = frames;
+            batched[i].checksum = gd_cave_adler_checksum(cave);
+        };
+        batch.add(std::move(jobs[i]));
+    }
+    SimulationStats stats = batch.run();
+
+    int different = 0;
+    for (unsigned i = 0; i < single.size(); ++i)
+        if (single[i] != batched[i])
+            different += 1;
+
+    unsigned nthreads = threads != 0 ? threads : gd_parallel_default_threads();
+    g_print("%s", Printf("Batch: %d games, at most %d frames each, on %d threads\n", stats.games, max_frames, nthreads).c_str());
+    g_print("%s", Printf("  one by one: %.2f s, %.1f games/s, %.0f frames/s, %d caves rendered\n",
+                         single_s, single_s > 0 ? jobs.size() / single_s : 0.0, single_s > 0 ? single_frames / single_s : 0.0, jobs.size()).c_str());
+    g_print("%s", Printf("  batch:      %.2f s, %.1f games/s, %.0f frames/s, %d caves rendered\n",
+                         stats.wall_time, stats.games_per_second(), stats.frames_per_second(), stats.renders).c_str());
+    if (different != 0)
+        g_print("%s", Printf("  %d games ended differently in the batch!\n", different).c_str());
+    return different == 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef ENGINEBENCH_HPP_INCLUDED
+#define ENGINEBENCH_HPP_INCLUDED
+
+#include "config.h"
+
+#include <string>
+#include <vector>
+
+#include "cave/cavetypes.hpp"
+#include "cave/helper/caverandom.hpp"
+
+class CaveSet;
+
+/// @ingroup Cave
+/// Random, but reproducible movements of the player.
+/// Used to play caves without replays in benchmarks and tests of the engine.
+/// The generator is seeded the same way every time, so the movements are the
+/// same for every run and every build. Other seeds give other movements.
+class ScriptedInput {
+    RandomGenerator random;
+    GdDirectionEnum player_move = MV_STILL;
+
+public:
+    explicit ScriptedInput(unsigned seed = 0): random(seed) {}
+    /// Get the movement for the next frame.
+    void next(GdDirectionEnum &move, bool &fire) {
+        /* change direction about every eighth frame, and press fire sometimes */
+        if (random.rand_int_range(0, 8) == 0)
+            player_move = GdDirectionEnum(random.rand_int_range(MV_STILL, MV_MAX));
+        move = player_move;
+        fire = random.rand_int_range(0, 16) == 0;
+    }
+};
+
+/// Output formats of the engine benchmark.
+enum GdBenchFormat {
+    GD_BENCH_FORMAT_TEXT,       ///< Human readable lines.
+    GD_BENCH_FORMAT_CSV,        ///< Comma separated values, one line per result.
+    GD_BENCH_FORMAT_JSON,       ///< A JSON object.
+};
+
+bool gd_bench_format_from_string(const char *str, GdBenchFormat &format);
+void gd_benchmark_engine(std::vector<CaveSet> const &cavesets, int frames, GdBenchFormat format = GD_BENCH_FORMAT_TEXT);
+void gd_benchmark_particles(int explosions);
+void gd_benchmark_render(int frames);
+void gd_benchmark_loader(std::vector<std::string> const &files, int repeats);
+bool gd_benchmark_batch(std::vector<CaveSet> const &cavesets, int games, unsigned threads);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "config.h"
+
+#include "cave/engineprofile.hpp"
+
+#ifdef GD_ENGINE_PROFILE
+
+#include <glib.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "cave/elementproperties.hpp"
+#include "misc/printf.hpp"
+
+namespace {
+
+/// Profiles of the threads which already finished.
+std::mutex finished_mutex;
+EngineProfile finished;
+
+/// The profile of a thread; it is added to the finished ones when the thread exits.
+struct ThreadProfile {
+    EngineProfile profile;
+    ~ThreadProfile() {
+        std::lock_guard<std::mutex> lock(finished_mutex);
+        finished.add(profile);
+    }
+};
+
+thread_local ThreadProfile thread_profile;
+
+/// The number of allocations made with operator new, by all threads.
+std::atomic<uint64_t> allocations(0);
+
+char const *phase_names[] = { "prepare", "scan", "unscan", "scheduling", "bookkeeping", "sound" };
+static_assert(EngineProfile::PhaseMax == G_N_ELEMENTS(phase_names), "a name is needed for every phase");
+
+char const *element_name(unsigned e) {
+    return gd_element_properties[e].filename != NULL ? gd_element_properties[e].filename : visible_name(GdElementEnum(e));
+}
+
+/// The time it takes to read the clock, which is included in every measurement.
+uint64_t clock_overhead() {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 1000; ++i) {
+        uint64_t start = EngineProfile::ticks();
+        best = std::min(best, EngineProfile::ticks() - start);
+    }
+    return best;
+}
+
+double percent(uint64_t part, uint64_t whole) {
+    return whole > 0 ? 100.0 * part / whole : 0;
+}
+
+}
+
+
+/// Reset all counters to zero.
+void EngineProfile::clear() {
+    iterations = 0;
+    std::fill(element_visits, element_visits + O_MAX, 0);
+    std::fill(element_ticks, element_ticks + O_MAX, 0);
+    std::fill(phase_ticks, phase_ticks + PhaseMax, 0);
+    std::fill(phase_calls, phase_calls + PhaseMax, 0);
+}
+
+
+/// Add the counters of an other profile to this one.
+void EngineProfile::add(EngineProfile const &other) {
+    iterations += other.iterations;
+    for (unsigned i = 0; i < O_MAX; ++i) {
+        element_visits[i] += other.element_visits[i];
+        element_ticks[i] += other.element_ticks[i];
+    }
+    for (unsigned i = 0; i < PhaseMax; ++i) {
+        phase_ticks[i] += other.phase_ticks[i];
+        phase_calls[i] += other.phase_calls[i];
+    }
+}
+
+
+/// Create a table of the phases, and of the elements sorted by the time spent on them.
+/// @param max_elements Only this many elements are listed, the ones which took the most time.
+std::string EngineProfile::report(unsigned max_elements) const {
+    uint64_t total = 0;
+    for (unsigned i = 0; i < PhaseMax; ++i)
+        if (i != PhaseSound)    /* included in the other phases */
+            total += phase_ticks[i];
+    uint64_t per_iteration = iterations > 0 ? total / iterations : 0;
+
+    std::string s = Printf("%d iterations, %d ticks per iteration; reading the clock takes %d ticks, included in every visit\n",
+                           iterations, per_iteration, clock_overhead());
+    s += Printf("%-28s %12s %12s %7s\n", "phase", "calls", "ticks/iter", "share");
+    for (unsigned i = 0; i < PhaseMax; ++i)
+        s += Printf("%-28s %12d %12d %6.1f%%\n", phase_names[i], phase_calls[i],
+                    iterations > 0 ? phase_ticks[i] / iterations : 0, percent(phase_ticks[i], total));
+
+    std::vector<unsigned> elements;
+    uint64_t scan_total = 0;
+    for (unsigned e = 0; e < O_MAX; ++e)
+        if (element_visits[e] > 0) {
+            elements.push_back(e);
+            scan_total += element_ticks[e];
+        }
+    std::sort(elements.begin(), elements.end(), [this](unsigned a, unsigned b) {
+        return element_ticks[a] > element_ticks[b];
+    });
+    if (elements.size() > max_elements)
+        elements.resize(max_elements);
+    s += Printf("%-28s %12s %12s %12s %7s\n", "element", "visits", "visits/iter", "ticks/visit", "share");
+    for (unsigned e : elements)
+        s += Printf("%-28s %12d %12.1f %12.1f %6.1f%%\n", element_name(e), element_visits[e],
+                    double(element_visits[e]) / std::max<uint64_t>(iterations, 1),
+                    double(element_ticks[e]) / element_visits[e], percent(element_ticks[e], scan_total));
+    return s;
+}
+
+
+/// The element the main scan spent the most time on, and its share of the scan.
+std::string EngineProfile::hottest_element() const {
+    uint64_t scan_total = 0;
+    unsigned hottest = O_MAX;
+    for (unsigned e = 0; e < O_MAX; ++e) {
+        scan_total += element_ticks[e];
+        if (element_visits[e] > 0 && (hottest == O_MAX || element_ticks[e] > element_ticks[hottest]))
+            hottest = e;
+    }
+    if (hottest == O_MAX)
+        return "none";
+    return Printf("%s %.0f%%", element_name(hottest), percent(element_ticks[hottest], scan_total));
+}
+
+
+/// The profile of the current thread. The game engine updates this one.
+EngineProfile &gd_engine_profile() {
+    return thread_profile.profile;
+}
+
+
+/// The sum of the profiles of the current thread and all the threads which already finished.
+EngineProfile gd_engine_profile_total() {
+    std::lock_guard<std::mutex> lock(finished_mutex);
+    EngineProfile total = finished;
+    total.add(thread_profile.profile);
+    return total;
+}
+
+
+/// The number of memory allocations made with operator new so far, by all threads.
+/// Allocations of GLib, and of C code in general, are not included.
+uint64_t gd_engine_profile_allocations() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+
+/* replacements of the global operator new and delete, which count the allocations.
+ * the array forms call these, so they are counted, too. */
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size != 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+#endif  /* GD_ENGINE_PROFILE */
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef ENGINEPROFILE_HPP_INCLUDED
+#define ENGINEPROFILE_HPP_INCLUDED
+
+#include "config.h"
+
+/*
+ * Profiling counters of the game engine.
+ *
+ * They are only compiled in if GD_ENGINE_PROFILE is defined, for example by
+ * running configure with CPPFLAGS=-DGD_ENGINE_PROFILE. Otherwise the GD_PROFILE_
+ * macros used by CaveRendered::iterate() expand to nothing, so normal builds
+ * have no overhead at all.
+ */
+
+#ifdef GD_ENGINE_PROFILE
+
+#include <cstdint>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+#include "cave/cavetypes.hpp"
+
+/// @ingroup Cave
+/// Counters of where the game engine spends its time: the number of cells
+/// visited and the time spent on them for every element in the main scan of
+/// the cave, and the time spent in the phases of an iteration.
+/// Time is measured in ticks of the time stamp counter of the processor,
+/// or in nanoseconds where there is none.
+class EngineProfile {
+public:
+    /// Phases of CaveRendered::iterate().
+    enum Phase {
+        PhasePrepare,       ///< Everything before the scan: reappearing walls, suicide.
+        PhaseScan,          ///< The main scan of the cave.
+        PhaseUnscan,        ///< The pass after the scan: scanned flags, time penalties, player position.
+        PhaseScheduling,    ///< update_scheduling().
+        PhaseBookkeeping,   ///< Amoeba, magic wall, timers and the other cave variables.
+        PhaseSound,         ///< Selecting the sounds to play. Also included in the phase which plays the sound.
+        PhaseMax
+    };
+
+    uint64_t iterations;
+    uint64_t element_visits[O_MAX];
+    uint64_t element_ticks[O_MAX];
+    uint64_t phase_ticks[PhaseMax];
+    uint64_t phase_calls[PhaseMax];
+
+    EngineProfile() {
+        clear();
+    }
+    void clear();
+    void add(EngineProfile const &other);
+
+    /// Read the clock used for profiling.
+    static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+    /// Add the time since start to a phase.
+    /// @return The current time, which is the start of the next phase.
+    uint64_t phase_done(Phase phase, uint64_t start) {
+        uint64_t now = ticks();
+        phase_ticks[phase] += now - start;
+        phase_calls[phase] += 1;
+        return now;
+    }
+    /// Count a visit to a cell with the given element, which started at the given time.
+    void cell_done(GdElementEnum element, uint64_t start) {
+        element_visits[element] += 1;
+        element_ticks[element] += ticks() - start;
+    }
+
+    std::string report(unsigned max_elements = O_MAX) const;
+    std::string hottest_element() const;
+};
+
+EngineProfile &gd_engine_profile();
+EngineProfile gd_engine_profile_total();
+uint64_t gd_engine_profile_allocations();
+
+/// @ingroup Cave
+/// Adds the time until the end of the scope to a phase of the profile of the current thread.
+class EngineProfileScope {
+    EngineProfile &profile;
+    EngineProfile::Phase phase;
+    uint64_t start;
+
+public:
+    explicit EngineProfileScope(EngineProfile::Phase phase)
+        :   profile(gd_engine_profile()), phase(phase), start(EngineProfile::ticks()) {
+    }
+    ~EngineProfileScope() {
+        profile.phase_done(phase, start);
+    }
+};
+
+#define GD_PROFILE_ITERATION_BEGIN() \
+    EngineProfile &gd_profile = gd_engine_profile(); \
+    gd_profile.iterations += 1; \
+    uint64_t gd_profile_mark = EngineProfile::ticks()
+#define GD_PROFILE_PHASE_DONE(phase) \
+    gd_profile_mark = gd_profile.phase_done(EngineProfile::phase, gd_profile_mark)
+#define GD_PROFILE_CELL_BEGIN() \
+    uint64_t const gd_profile_cell = EngineProfile::ticks()
+#define GD_PROFILE_CELL_DONE(element) \
+    gd_profile.cell_done(element, gd_profile_cell)
+#define GD_PROFILE_SCOPE(phase) \
+    EngineProfileScope gd_profile_scope(EngineProfile::phase)
+
+#else
+
+#define GD_PROFILE_ITERATION_BEGIN()
+#define GD_PROFILE_PHASE_DONE(phase)
+#define GD_PROFILE_CELL_BEGIN()
+#define GD_PROFILE_CELL_DONE(element)
+#define GD_PROFILE_SCOPE(phase)
+
+#endif  /* GD_ENGINE_PROFILE */
+
+#endif
@@ -24,11 +24,16 @@
 
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <algorithm>
+#include <stdexcept>
 
 #include "cave/gamecontrol.hpp"
 #include "cave/cavestored.hpp"
 #include "cave/caverendered.hpp"
 #include "cave/caveset.hpp"
+#include "cave/cavestate.hpp"
+#include "fileops/checksumcache.hpp"
+#include "fileops/loadfile.hpp"
 #include "sound/sound.hpp"
 #include "misc/util.hpp"
 #include "input/gameinputhandler.hpp"
@@ -66,6 +71,7 @@ GameControl::GameControl(Type type) :
     type(type),
     player_score(0),
     player_lives(0),
+    highest_score(0),
     caveset(NULL),
     played_cave(),
     original_cave(NULL),
@@ -77,7 +83,10 @@ GameControl::GameControl(Type type) :
     cave_num(0),
     level_num(0),
     milliseconds_game(0),
-    state_counter(GAME_INT_LOAD_CAVE) {
+    state_counter(GAME_INT_LOAD_CAVE),
+    caveset_checksum_known(false),
+    caveset_checksum(0),
+    rewind_buffer(size_t(std::max(gd_rewind_buffer_size, 0)) * 1024 * 1024) {
 }
 
 /// Create a full game from the caveset.
@@ -153,16 +162,18 @@ void GameControl::add_bonus_life(bool inform_user) {
 /// Store in the game score, in player score, and also in the replay, if any.
 /// If a bonus life is got, show bonus life flash.
 void GameControl::increment_score(int increment) {
-    /* remember original score */
+    /* remember original score. after rewinding, it might be lower than already reached;
+     * the bonus lives for that are not given again. */
     int prev = 0;
     if (caveset)
-        prev = player_score / caveset->bonus_life_score;
+        prev = std::max(player_score, highest_score) / caveset->bonus_life_score;
     /* add score */
     player_score += increment;
     cave_score += increment;
+    highest_score = std::max(highest_score, player_score);
     if (replay_record.get())  /* also record to replay */
         replay_record->score += increment;
-    if (caveset && player_score / caveset->bonus_life_score > prev)
+    if (caveset && highest_score / caveset->bonus_life_score > prev)
         add_bonus_life(true);   /* if score crossed bonus_life_score point boundary, player won a bonus life */
 }
 
@@ -200,6 +211,11 @@ void GameControl::load_cave() {
             replay_record->recorded_with = PACKAGE_STRING;                  // name of gdash and version
             replay_record->player_name = player_name;
             replay_record->date = gd_get_current_date_time();
+            replay_index = std::make_unique<ReplayIndex>();
+            replay_index->start(*played_cave);
+
+            /* autosave to the first state slot; it is only kept in memory, so starting the cave stays quick */
+            save_state(0);
             break;
 
         case TYPE_TEST:
@@ -226,6 +242,8 @@ void GameControl::load_cave() {
             /* -1 is because level=1 is in bdcff for level 1, and internally we number levels from 0 */
             played_cave = std::make_unique<CaveRendered>(*original_cave, replay_from->level - 1, replay_from->seed);
             played_cave->setup_for_game();
+            /* if there is no index yet, it is created when first seeking in the replay */
+            replay_index = gd_replay_index_load(*original_cave, *replay_from);
             break;
 
         case TYPE_CONTINUE_REPLAY:
@@ -235,6 +253,9 @@ void GameControl::load_cave() {
 
     milliseconds_game = 0;      /* set game timer to zero, too */
     state_counter = GAME_INT_SHOW_STORY;
+
+    rewind_buffer.clear();
+    remember_frame();
 }
 
 
@@ -260,12 +281,217 @@ bool GameControl::load_snapshot() {
     //*this = GameControl(TYPE_SNAPSHOT); // triggers uncover mosaic and as side effect entering outbox will end the game instead of loading next cave!
     played_cave = std::make_unique<CaveRendered>(*snapshot_cave);
     player_score = snapshot_cave->score;
+    replay_index.reset();
+    rewind_buffer.clear();
+    remember_frame();
 
     /* success */
     return true;
 }
 
 
+/// Name of the file of a save state slot.
+/// The checksum of the caveset is only looked up once in a game, and not at
+/// every cave, when the state is saved automatically.
+std::string GameControl::state_filename(int slot) const {
+    if (!caveset_checksum_known) {
+        caveset_checksum = gd_caveset_checksum_cached(*caveset);
+        caveset_checksum_known = true;
+    }
+    return gd_cave_state_filename(*caveset, caveset_checksum, slot);
+}
+
+
+/// Save the state of the played cave to a file in the user config directory,
+/// or to memory for slot 0. Only possible for games played from a caveset.
+/// @param slot The number of the slot, 0 <= slot < StateSlots.
+/// @return true, if successful
+bool GameControl::save_state(int slot) {
+    if (type != TYPE_NORMAL || played_cave.get() == NULL || caveset == NULL || original_cave == NULL)
+        return false;
+
+    CaveStateInfo info;
+    info.cave_index = original_cave - &caveset->caves[0];
+    info.player_score = player_score;
+    if (slot == 0) {
+        autosave_state = gd_cave_state_save(*played_cave, info);
+        return true;
+    }
+    try {
+        save_vector_to_file(state_filename(slot).c_str(), gd_cave_state_save(*played_cave, info));
+    } catch (std::exception &e) {
+        return false;
+    }
+    return true;
+}
+
+
+/// Replace the played cave with a state saved by save_state().
+/// Only possible in a normal game, while the cave is running.
+/// The state must be of the same cave which is played now. The replay
+/// recorded so far does not lead to that state, so it is dropped.
+/// @param slot The number of the slot, 0 <= slot < StateSlots.
+/// @return true, if successful
+bool GameControl::load_state(int slot) {
+    if (type != TYPE_NORMAL || played_cave.get() == NULL || caveset == NULL || original_cave == NULL)
+        return false;
+    if (state_counter != GAME_INT_CAVE_RUNNING)
+        return false;
+
+    std::vector<unsigned char> data;
+    if (slot == 0)
+        data = autosave_state;
+    else {
+        try {
+            data = load_file_to_vector(state_filename(slot).c_str());
+        } catch (std::exception &e) {
+            return false;
+        }
+        data.pop_back();    /* the terminating zero added by the loader */
+    }
+    CaveStateInfo info;
+    if (!gd_cave_state_info(data, info))
+        return false;
+    if (info.cave_index != original_cave - &caveset->caves[0])
+        return false;
+
+    auto cave = std::make_unique<CaveRendered>(*original_cave, info.level, info.seed);
+    cave->setup_for_game();
+    if (!gd_cave_state_load(*cave, data))
+        return false;
+    played_cave = std::move(cave);
+    /* the score collected in the cave changes too, as for rewinding */
+    int score_difference = info.player_score - player_score;
+    player_score += score_difference;
+    cave_score += score_difference;
+    replay_record.reset();
+    replay_index.reset();
+    rewind_buffer.clear();
+    remember_frame();
+
+    /* success */
+    return true;
+}
+
+
+/// Store the current state of the played cave in the rewind buffer.
+/// Along with the state, the position in the replay is remembered.
+void GameControl::remember_frame() {
+    if (played_cave.get() == NULL || !rewind_buffer.enabled())
+        return;
+
+    CaveStateInfo info;
+    info.player_score = player_score;
+    unsigned int replay_pos = 0;
+    if (type == TYPE_REPLAY)
+        replay_pos = replay_from->position();
+    else if (replay_record.get() != NULL)
+        replay_pos = replay_record->length();
+    rewind_buffer.push(gd_cave_state_save(*played_cave, info), replay_pos);
+}
+
+
+/// Go back in time in the played cave.
+/// Only possible while the cave is running. When viewing a replay, it
+/// continues from the movement of the restored frame; the replay being
+/// recorded forgets the movements after it, so it stays playable.
+/// @param frames The number of cave frames to go back.
+/// @return true if successful, false if there was nothing to rewind.
+bool GameControl::rewind(unsigned int frames) {
+    if (played_cave.get() == NULL || state_counter != GAME_INT_CAVE_RUNNING)
+        return false;
+
+    std::vector<unsigned char> data;
+    unsigned int replay_pos;
+    CaveStateInfo info;
+    if (!rewind_buffer.rewind(frames, data, replay_pos) || !gd_cave_state_info(data, info))
+        return false;
+    if (!gd_cave_state_load(*played_cave, data))
+        return false;
+
+    int score_difference = info.player_score - player_score;
+    player_score += score_difference;
+    cave_score += score_difference;
+    if (type == TYPE_REPLAY) {
+        replay_from->seek(replay_pos);
+        replay_no_more_movements = 0;
+    } else if (replay_record.get() != NULL) {
+        replay_record->truncate(replay_pos);
+        if (replay_index.get() != NULL)
+            replay_index->truncate(replay_pos);
+        replay_record->score += score_difference;
+    }
+    milliseconds_game = 0;
+
+    return true;
+}
+
+
+/// Jump to a position in the replay being viewed.
+/// The frames in between are simulated as fast as possible, without drawing,
+/// sounds or particles. The simulation starts from the nearest keyframe of the
+/// replay index, which is built on the first seek, or from the start of the cave.
+/// The simulation stops early if the player dies or exits the cave, so the
+/// game can go on from there as usual.
+/// @param movement The number of movements of the replay to be played.
+/// @return true if successful, false if not viewing a replay or the cave is not uncovered yet.
+bool GameControl::seek_replay(unsigned int movement) {
+    if (type != TYPE_REPLAY || played_cave.get() == NULL)
+        return false;
+    if (state_counter <= GAME_INT_START_UNCOVER || state_counter > GAME_INT_CAVE_RUNNING)
+        return false;
+    if (state_counter < GAME_INT_CAVE_RUNNING)
+        uncover_all();
+
+    if (replay_index.get() == NULL) {
+        replay_index = ReplayIndex::build(*original_cave, *replay_from);
+        gd_replay_index_save(*original_cave, *replay_from, *replay_index);
+    }
+
+    /* start from the keyframe before the movement, if it saves some frames. */
+    ReplayIndex::Keyframe const *keyframe = replay_index->find(movement);
+    std::unique_ptr<CaveRendered> restored;
+    if (keyframe != NULL && (movement < replay_from->position() || keyframe->movement > replay_from->position()))
+        restored = replay_index->restore(*original_cave, *replay_from, *keyframe);
+    if (restored.get() != NULL) {
+        played_cave = std::move(restored);
+        replay_from->seek(keyframe->movement);
+        player_score += keyframe->score - cave_score;
+        cave_score = keyframe->score;
+    } else if (movement < replay_from->position()) {
+        /* no keyframe; play the cave again from the start */
+        played_cave = std::make_unique<CaveRendered>(*original_cave, replay_from->level - 1, replay_from->seed);
+        played_cave->setup_for_game();
+        replay_from->rewind();
+        player_score -= cave_score;
+        cave_score = 0;
+    }
+
+    GdDirectionEnum player_move;
+    bool fire, suicide;
+    while (replay_from->position() < movement
+            && played_cave->player_state != GD_PL_DIED && played_cave->player_state != GD_PL_TIMEOUT && played_cave->player_state != GD_PL_EXITED
+            && replay_from->get_next_movement(player_move, fire, suicide)) {
+        played_cave->iterate(player_move, fire, suicide);
+        if (played_cave->score)
+            increment_score(played_cave->score);
+        played_cave->particles.clear();
+    }
+    played_cave->clear_sounds();
+    gd_sound_play_sounds(played_cave->sound1, played_cave->sound2, played_cave->sound3);
+    if (played_cave->hatched)
+        set_status_bar_state(status_bar_game);
+    replay_no_more_movements = 0;
+    milliseconds_game = 0;
+
+    /* the frames skipped are not in the rewind buffer */
+    rewind_buffer.clear();
+    remember_frame();
+
+    return true;
+}
+
+
 bool GameControl::is_uncovering() const {
     return state_counter > GAME_INT_START_UNCOVER && state_counter < GAME_INT_UNCOVER_ALL;
 }
@@ -433,6 +659,9 @@ GameControl::State GameControl::iterate_cave(GameInputHandler *inputhandler) {
         played_cave->iterate(player_move, fire, suicide);
         if (played_cave->score)
             increment_score(played_cave->score);
+        if (replay_record.get() != NULL && replay_index.get() != NULL)
+            replay_index->add(*played_cave, replay_record->length(), cave_score);
+        remember_frame();
         return_state = STATE_NOTHING;
         /* as we iterated, the score and the like could have been changed.
          * but only do this if the player is not hatched yet (ie only after cave start signal) */
@@ -538,8 +767,12 @@ void GameControl::unload_cave() {
     /* if this is a normal game: */
     if (type == TYPE_NORMAL) {
         // if the replay was successful, or it has some length which makes sense, add it to the cave.
-        if (replay_record->success || replay_record->length() >= 16)
+        // there is no replay, if a saved state was loaded.
+        if (replay_record.get() != NULL && (replay_record->success || replay_record->length() >= 16)) {
             original_cave->replays.push_back(*replay_record);
+            if (replay_index.get() != NULL)
+                gd_replay_index_save(*original_cave, *replay_record, *replay_index);
+        }
         replay_record.release();
 
         // if the cave was successful, manage bonus life and points
@@ -26,10 +26,13 @@
 #include "config.h"
 
 #include <memory>
+#include <vector>
 #include "cave/helper/cavemap.hpp"
 #include "cave/cavetypes.hpp"
 #include "cave/caverendered.hpp"
 #include "cave/helper/cavereplay.hpp"
+#include "cave/caverewind.hpp"
+#include "cave/replayindex.hpp"
 
 // forward declarations
 class CaveSet;
@@ -132,9 +135,21 @@ public:
     /// Default constructor - only used internally by the named constructors.
     GameControl(Type type);
 
+    /// Number of save state slots. Slot 0 is set automatically at the start of every cave,
+    /// and is kept in memory only; the others are saved to files.
+    enum { StateSlots = 10 };
+
     /* functions to work on */
     bool save_snapshot() const;
     bool load_snapshot();
+    bool save_state(int slot);
+    bool load_state(int slot);
+    bool rewind(unsigned int frames);
+    bool seek_replay(unsigned int movement);
+    /// The number of movements in the replay being viewed, zero if not viewing a replay.
+    unsigned int replay_length() const {
+        return type == TYPE_REPLAY ? replay_from->length() : 0;
+    }
     State main_int(GameInputHandler *inputhandler, bool allow_iterate);
     bool is_uncovering() const;
 
@@ -144,6 +159,7 @@ public:
     std::string player_name;    ///< Name of player
     int player_score;           ///< Score of player
     int player_lives;           ///< Remaining lives of player
+    int highest_score;          ///< Highest score reached; can be more than player_score after rewinding
 
     CaveSet *caveset;           ///< Caveset used to load next cave in normal games.
     std::unique_ptr<CaveRendered> played_cave;  ///< Rendered version of the cave. This is the iterated one
@@ -162,20 +178,27 @@ public:
 
 private:
     std::unique_ptr<CaveReplay> replay_record;
+    std::unique_ptr<ReplayIndex> replay_index;  ///< keyframes of the replay recorded or viewed
     CaveReplay *replay_from;
     unsigned int cave_num;      ///< actual playing cave number
     unsigned int level_num;     ///< actual playing level
     int cave_score;             ///< score collected in this cave
     int milliseconds_game;      ///< here we remember, how many milliseconds have passed since we last iterated the cave
     int state_counter;          ///< counter used to control the game flow, rendering of caves
+    mutable bool caveset_checksum_known;    ///< true, if caveset_checksum is already calculated
+    mutable unsigned caveset_checksum;      ///< checksum of the caveset, for the names of the state files
+    RewindBuffer rewind_buffer; ///< states of the last frames of the cave, for rewinding
+    std::vector<unsigned char> autosave_state;  ///< save state slot 0, the start of the cave
     
     static std::unique_ptr<CaveRendered> snapshot_cave;   ///< Saved snapshot
 
     void add_bonus_life(bool inform_user);
     void increment_score(int increment);
     void select_next_level_indexes();
+    void remember_frame();
 
     void set_status_bar_state(StatusBarState s);
+    std::string state_filename(int slot) const;
 
     /* internal functions for the different states */
     void load_cave();
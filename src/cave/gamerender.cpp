@@ -24,6 +24,7 @@
 #include "config.h"
 
 #include <glib/gi18n.h>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <numeric>
@@ -255,8 +256,9 @@ bool GameRenderer::scroll(int ms, bool exact_scroll) {
 
     /* if scrolling, we should update entire screen. */
     if (scrolled && !game.gfx_buffer.empty()) {
-        for (int y = 0; y < game.played_cave->h; y++)
-            for (int x = 0; x < game.played_cave->w; x++)
+        CellRect const area = visible_cells();
+        for (int y = area.y1; y <= area.y2; y++)
+            for (int x = area.x1; x <= area.x2; x++)
                 game.gfx_buffer(x, y) |= GD_REDRAW;
     }
 
@@ -284,6 +286,29 @@ bool GameRenderer::scroll(int ms, bool exact_scroll) {
 }
 
 
+/**
+ * Calculate which cells of the cave are on the screen at the current scroll position.
+ * Only these have to be rendered to the gfx buffer and drawn, which makes the
+ * drawing cost of a frame depend on the size of the screen and not on the size
+ * of the cave. A margin of some cells is added around the play area, so the
+ * rounding of the scroll position (fine scrolling, pal emulation) and the
+ * centering of small caves never leave an undrawn cell at the edges.
+ * @return The cells on the screen, clipped to the visible area of the cave.
+ */
+CellRect GameRenderer::visible_cells() const {
+    int const margin = 2;
+    int cell_size = cells.get_cell_size();
+    CaveRendered const &cave = *game.played_cave;
+
+    CellRect area;
+    area.x1 = std::max<int>(cave.x1, cave.x1 + int(scroll_x) / cell_size - margin);
+    area.y1 = std::max<int>(cave.y1, cave.y1 + int(scroll_y) / cell_size - margin);
+    area.x2 = std::min<int>(cave.x2, cave.x1 + (int(scroll_x) + play_area_w) / cell_size + margin);
+    area.y2 = std::min<int>(cave.y2, cave.y1 + (int(scroll_y) + play_area_h) / cell_size + margin);
+    return area;
+}
+
+
 void GameRenderer::drawcave() const {
     int cell_size = cells.get_cell_size();
 
@@ -324,13 +349,14 @@ void GameRenderer::drawcave() const {
     }
 
     /* here we draw all cells to be redrawn. the in-cell clipping will be done by the graphics
-     * engine, we only clip full cells. */
+     * engine, we only clip full cells; cells which are off the screen are not even checked. */
     /* the x and y coordinates are cave physical coordinates.
      * xd and yd are relative to the visible area. */
+    CellRect const area = visible_cells();
     int x, y, xd, yd;
-    for (y = game.played_cave->y1, yd = 0; y <= game.played_cave->y2; y++, yd++) {
+    for (y = area.y1, yd = area.y1 - game.played_cave->y1; y <= area.y2; y++, yd++) {
         int ys = yplus - scroll_y_aligned + statusbar_height + yd * cell_size;
-        for (x = game.played_cave->x1, xd = 0; x <= game.played_cave->x2; x++, xd++) {
+        for (x = area.x1, xd = area.x1 - game.played_cave->x1; x <= area.x2; x++, xd++) {
             if (game.gfx_buffer(x, y) & GD_REDRAW) {    /* if it needs to be redrawn */
                 // calculate on-screen coordinates
                 int xs = xplus - scroll_x + xd * cell_size;
@@ -345,16 +371,16 @@ void GameRenderer::drawcave() const {
     if (gd_particle_effects) {
         int xs = xplus - scroll_x - game.played_cave->x1 * cell_size;
         int ys = yplus + statusbar_height - scroll_y_aligned - game.played_cave->y1 * cell_size;
-        std::list<ParticleSet>::const_iterator it;
-        for (it = game.played_cave->particles.begin(); it != game.played_cave->particles.end(); ++it)
-            screen.draw_particle_set(xs, ys, *it);
+        ParticlePool const &particles = game.played_cave->particles;
+        for (size_t i = 0; i < particles.num_sets(); ++i)
+            screen.draw_particle_set(xs, ys, particles, particles.set(i));
     }
 
     /* if using particle effects, the whole cave needs to be redrawn later. */
     if (gd_particle_effects) {
-        /* remember to redraw the whole cave */
-        for (int y = game.played_cave->y1; y <= game.played_cave->y2; y++)
-            for (int x = game.played_cave->x1; x <= game.played_cave->x2; x++)
+        /* remember to redraw the whole cave - the part of it on the screen */
+        for (y = area.y1; y <= area.y2; y++)
+            for (x = area.x1; x <= area.x2; x++)
                 game.gfx_buffer(x, y) |= GD_REDRAW;
     }
 
@@ -719,8 +745,9 @@ void GameRenderer::draw(bool full) const {
         // all cave cells must be drawn
         if (full) {
             must_clear_screen = true;
-            for (int y = game.played_cave->y1; y <= game.played_cave->y2; y++)
-                for (int x = game.played_cave->x1; x <= game.played_cave->x2; x++)
+            CellRect const area = visible_cells();
+            for (int y = area.y1; y <= area.y2; y++)
+                for (int x = area.x1; x <= area.x2; x++)
                     game.gfx_buffer(x, y) |= GD_REDRAW;
         }
         if (full || must_draw_cave)
@@ -755,12 +782,6 @@ void GameRenderer::screen_initialized() {
     story.linesavailable = screen.get_height() / font_manager.get_line_height() - 6;
 }
 
-/** For removing old particles (a predicate) */
-static bool old_particle(ParticleSet const &ps) {
-    return ps.life < 0;
-}
-
-
 GameRenderer::State GameRenderer::main_int(int millisecs_elapsed, bool paused, GameInputHandler *inputhandler) {
     GameControl::State state = GameControl::STATE_NOTHING;
 
@@ -832,16 +853,12 @@ GameRenderer::State GameRenderer::main_int(int millisecs_elapsed, bool paused, G
         out_of_window = scroll(millisecs_elapsed, game.played_cave->player_state == GD_PL_NOT_YET);
 
         /* move the particles */
-        std::list<ParticleSet>::iterator it;
-        for (it = game.played_cave->particles.begin(); it != game.played_cave->particles.end(); ++it) {
-            if (it->is_new)
-                it->normalize(cells.get_cell_size());
-            it->move(millisecs_elapsed);
-        }
-        game.played_cave->particles.remove_if(old_particle);
+        game.played_cave->particles.normalize(cells.get_cell_size());
+        game.played_cave->particles.move(millisecs_elapsed);
 
-        /* always render the cave to the gfx buffer; however it may do nothing if animcycle was not changed. */
-        game.played_cave->draw_indexes(game.gfx_buffer, game.covered, game.bonus_life_flash > 0, animcycle, gd_no_invisible_outbox);
+        /* always render the cave to the gfx buffer; however it may do nothing if animcycle was not changed.
+         * only the cells on the screen are rendered; the ones which scroll in are marked by scroll() above. */
+        game.played_cave->draw_indexes(game.gfx_buffer, game.covered, game.bonus_life_flash > 0, animcycle, gd_no_invisible_outbox, visible_cells());
 
         /* draw the cave. */
         must_draw_cave = true;
@@ -39,6 +39,7 @@ class CellRenderer;
 class FontManager;
 class GameControl;
 class GameInputHandler;
+struct CellRect;
 class Pixbuf;
 class Pixmap;
 
@@ -116,6 +117,7 @@ class GameRenderer : public PixmapStorage {
     bool cave_scroll(int logical_size, int physical_size, int center, bool exact, double &current, int &desired, double & currspeed);
     bool scroll(int ms, bool exact_scroll);
     void scroll_to_origin();
+    CellRect visible_cells() const;
 
     void drawstory() const;
     void drawcave() const;
@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <glib.h>
+#include <algorithm>
+#include <map>
+
+#include "cave/caveset.hpp"
+#include "cave/caverendered.hpp"
+#include "cave/elementproperties.hpp"
+#include "cave/enginebench.hpp"
+#include "cave/replayverify.hpp"
+#include "cave/helper/cavereplay.hpp"
+#include "misc/autogfreeptr.hpp"
+#include "misc/bytestream.hpp"
+#include "misc/parallel.hpp"
+#include "misc/printf.hpp"
+
+#include "cave/goldenhash.hpp"
+
+/*
+ * The golden file is little-endian binary:
+ *
+ *   "GDGH", version, number of runs
+ *   for each run: length of key, key, width of the cave, number of frames,
+ *       the map and scalar hash of each frame, size of changes, changes
+ *
+ * The changes of a frame are stored as varints: the number of cells changed,
+ * then for each cell the distance of its index (y*width+x) from the one after
+ * the previous changed cell, and the new element.
+ */
+
+namespace {
+
+char const golden_magic[4] = {'G', 'D', 'G', 'H'};
+enum { GOLDEN_VERSION = 1 };
+
+/// Mix a 64-bit word into the hash.
+inline uint64_t hash_step(uint64_t h, uint64_t v) {
+    h = (h ^ v) * 0x9e3779b97f4a7c15ull;
+    return h ^ (h >> 29);
+}
+
+/// Four cells of a row as a 64-bit word, independently of the byte order of the machine.
+inline uint64_t four_cells(uint16_t const *cells) {
+    return uint64_t(cells[0]) | uint64_t(cells[1]) << 16 | uint64_t(cells[2]) << 32 | uint64_t(cells[3]) << 48;
+}
+
+/// Fold the hash to 32 bits.
+inline uint32_t hash_final(uint64_t h) {
+    h ^= h >> 32;
+    h *= 0xd6e8feb86659fd93ull;
+    return uint32_t(h ^ (h >> 32));
+}
+
+/// Stores the hash and the changed cells of a cave after every frame into a GoldenRun.
+class GoldenRecorder {
+    GoldenRun &run;
+    bool cells;
+    std::vector<uint16_t> previous;     ///< the map after the previous frame, if recording cells
+
+    void store_map(CaveRendered const &cave) {
+        int w = cave.map.width();
+        for (int y = 0; y < cave.map.height(); ++y)
+            std::copy(cave.map.row(y), cave.map.row(y) + w, previous.begin() + y * w);
+    }
+
+public:
+    /// If recording the cells, the cave is set to list the cells changed in each frame,
+    /// so only these have to be compared to the previous frame.
+    GoldenRecorder(GoldenRun &run, CaveRendered &cave, bool cells)
+        :   run(run), cells(cells) {
+        run.width = cave.map.width();
+        if (cells) {
+            previous.resize(cave.map.width() * cave.map.height());
+            store_map(cave);
+            cave.track_changed_cells();
+        }
+    }
+
+    void frame_done(CaveRendered const &cave) {
+        run.frames.push_back(gd_cave_frame_hash(cave));
+        if (!cells)
+            return;
+        int w = cave.map.width();
+        std::vector<std::pair<size_t, uint16_t>> changed;
+        for (int cell : cave.changed_cells()) {
+            size_t const pos = cave.map.y_of(cell) * w + cave.map.x_of(cell);
+            uint16_t const element = cave.map.at(cell);
+            if (element != previous[pos]) {
+                changed.push_back(std::make_pair(pos, element));
+                previous[pos] = element;
+            }
+        }
+        /* the changes are stored in the order of the cells */
+        std::sort(changed.begin(), changed.end());
+        gd_put_varint(run.changes, changed.size());
+        size_t next = 0;
+        for (auto const &cell : changed) {
+            gd_put_varint(run.changes, cell.first - next);
+            gd_put_varint(run.changes, cell.second);
+            next = cell.first + 1;
+        }
+    }
+};
+
+/// Get the cells changed in a frame.
+/// @param pos The position of the changes of the frame; moved to the next frame.
+/// @return false, if the data is corrupt.
+bool read_frame_changes(std::vector<unsigned char> const &data, size_t &pos, std::map<size_t, size_t> &changed) {
+    size_t count, index = 0, skip, element;
+    changed.clear();
+    if (!gd_get_varint(data, pos, count))
+        return false;
+    for (size_t i = 0; i < count; ++i) {
+        if (!gd_get_varint(data, pos, skip) || !gd_get_varint(data, pos, element))
+            return false;
+        index += skip;
+        changed[index] = element;
+        index += 1;
+    }
+    return true;
+}
+
+/// Skip the changes of the first frames of a run.
+bool skip_frames(std::vector<unsigned char> const &data, size_t &pos, size_t frames) {
+    std::map<size_t, size_t> changed;
+    for (size_t i = 0; i < frames; ++i)
+        if (!read_frame_changes(data, pos, changed))
+            return false;
+    return true;
+}
+
+std::string element_name(std::map<size_t, size_t> const &changed, size_t index) {
+    auto it = changed.find(index);
+    if (it == changed.end())
+        return "unchanged";
+    if (it->second < O_MAX && gd_element_properties[it->second].filename != NULL)
+        return gd_element_properties[it->second].filename;
+    return Printf("%d", it->second);
+}
+
+/// Describe where the frame of a run diverges from the golden run.
+/// If both have the changed cells recorded, the first cell with a different
+/// change is searched for. The cave is the same before the frame, as the hash
+/// of the previous frame is the same.
+std::string describe_divergence(GoldenRun const &golden, GoldenRun const &run, size_t frame) {
+    char const *what;
+    if (golden.frames[frame].map != run.frames[frame].map)
+        what = golden.frames[frame].scalars != run.frames[frame].scalars ? "the map and the variables differ" : "the map differs";
+    else
+        what = "the variables differ";
+    std::string description = Printf("frame %d, %s", frame + 1, what);
+    if (golden.changes.empty() || run.changes.empty() || golden.width != run.width || golden.width == 0)
+        return description;
+
+    size_t golden_pos = 0, run_pos = 0;
+    std::map<size_t, size_t> golden_changed, run_changed;
+    if (!skip_frames(golden.changes, golden_pos, frame) || !read_frame_changes(golden.changes, golden_pos, golden_changed)
+            || !skip_frames(run.changes, run_pos, frame) || !read_frame_changes(run.changes, run_pos, run_changed))
+        return description;
+    /* the first index where the changes are different */
+    std::vector<size_t> indices;
+    for (auto const &cell : golden_changed)
+        indices.push_back(cell.first);
+    for (auto const &cell : run_changed)
+        indices.push_back(cell.first);
+    std::sort(indices.begin(), indices.end());
+    for (size_t index : indices) {
+        std::string expected = element_name(golden_changed, index), got = element_name(run_changed, index);
+        if (expected != got)
+            return Printf("%s, first at cell (%d, %d): expected %s, got %s",
+                          description, index % golden.width, index / golden.width, expected, got);
+    }
+    return description;
+}
+
+}
+
+
+/// Calculate a hash of the state of a cave, after an iteration.
+/// The map is hashed four cells at a time, in four independent lanes, so this
+/// is cheap compared to the iteration itself. Everything is hashed which affects the following
+/// iterations, apart from the complete state of the random number generator,
+/// of which only the position is taken.
+FrameHash gd_cave_frame_hash(CaveRendered const &cave) {
+    CaveMapCompact const &map = cave.map;
+    int w = map.width();
+
+    /* four independent lanes, so the multiplications can overlap */
+    uint64_t a = hash_step(0, uint64_t(w) << 32 | map.height()), b = 1, c = 2, d = 3;
+    for (int y = 0; y < map.height(); ++y) {
+        uint16_t const *row = map.row(y);
+        int x = 0;
+        for (; x + 16 <= w; x += 16) {
+            a = hash_step(a, four_cells(row + x));
+            b = hash_step(b, four_cells(row + x + 4));
+            c = hash_step(c, four_cells(row + x + 8));
+            d = hash_step(d, four_cells(row + x + 12));
+        }
+        /* the rest of the row, at most 15 cells */
+        if (x + 4 <= w) {
+            a = hash_step(a, four_cells(row + x));
+            x += 4;
+        }
+        if (x + 4 <= w) {
+            b = hash_step(b, four_cells(row + x));
+            x += 4;
+        }
+        if (x + 4 <= w) {
+            c = hash_step(c, four_cells(row + x));
+            x += 4;
+        }
+        uint64_t rest = 1;
+        for (; x < w; ++x)
+            rest = rest << 16 | row[x];
+        d = hash_step(d, rest);
+    }
+    uint64_t h = hash_step(hash_step(hash_step(a, b), c), d);
+
+    int const scalars[] = {
+        cave.score, cave.time, cave.time_elapsed, cave.speed, cave.ckdelay_current,
+        cave.player_state, cave.player_x, cave.player_y, cave.player_seen_ago, cave.kill_player, cave.sweet_eaten,
+        cave.diamonds_collected, cave.diamonds_needed, cave.skeletons_collected, cave.gate_open,
+        cave.hatched, cave.hatching_delay_frame, cave.hatching_delay_time,
+        cave.amoeba_state, cave.amoeba_2_state, cave.amoeba_time, cave.amoeba_2_time,
+        cave.magic_wall_state, cave.magic_wall_time,
+        cave.key1, cave.key2, cave.key3, cave.diamond_key_collected,
+        cave.gravity, cave.gravity_will_change, cave.gravity_disabled, cave.gravity_next_direction,
+        cave.creatures_backwards, cave.creatures_direction_will_change,
+        cave.biters_wait_frame, cave.replicators_wait_frame,
+        cave.got_pneumatic_hammer, cave.pneumatic_hammer_active_delay,
+        cave.sound1.sound, cave.sound2.sound, cave.sound3.sound,
+        int(cave.random.get_state().mti), cave.c64_rand.get_seed(),
+    };
+    uint64_t s = 0;
+    for (size_t i = 0; i < G_N_ELEMENTS(scalars); i += 2)
+        s = hash_step(s, uint64_t(uint32_t(scalars[i])) << 32 | uint32_t(i + 1 < G_N_ELEMENTS(scalars) ? scalars[i + 1] : 0));
+
+    return FrameHash{hash_final(h), hash_final(s)};
+}
+
+
+/// Save golden runs to the data of a golden file.
+std::vector<unsigned char> gd_golden_save(std::vector<GoldenRun> const &runs) {
+    std::vector<unsigned char> data(golden_magic, golden_magic + sizeof(golden_magic));
+    gd_put32(data, GOLDEN_VERSION);
+    gd_put32(data, runs.size());
+    for (GoldenRun const &run : runs) {
+        gd_put32(data, run.key.size());
+        data.insert(data.end(), run.key.begin(), run.key.end());
+        gd_put32(data, run.width);
+        gd_put32(data, run.frames.size());
+        for (FrameHash const &frame : run.frames) {
+            gd_put32(data, frame.map);
+            gd_put32(data, frame.scalars);
+        }
+        gd_put32(data, run.changes.size());
+        data.insert(data.end(), run.changes.begin(), run.changes.end());
+    }
+    return data;
+}
+
+
+/// Load golden runs from the data of a golden file.
+/// @return false, if the data is not a golden file of the current version.
+bool gd_golden_load(std::vector<unsigned char> const &data, std::vector<GoldenRun> &runs) {
+    size_t pos = sizeof(golden_magic);
+    uint32_t version, count;
+    if (data.size() < pos || !std::equal(golden_magic, golden_magic + sizeof(golden_magic), data.begin()))
+        return false;
+    if (!gd_get32(data, pos, version) || version != GOLDEN_VERSION || !gd_get32(data, pos, count))
+        return false;
+
+    std::vector<GoldenRun> new_runs;
+    for (uint32_t i = 0; i < count; ++i) {
+        GoldenRun run;
+        uint32_t size, width, frames;
+        if (!gd_get32(data, pos, size) || size > data.size() - pos)
+            return false;
+        run.key.assign(data.begin() + pos, data.begin() + pos + size);
+        pos += size;
+        if (!gd_get32(data, pos, width) || !gd_get32(data, pos, frames) || frames > (data.size() - pos) / 8)
+            return false;
+        run.width = width;
+        run.frames.resize(frames);
+        for (FrameHash &frame : run.frames)
+            if (!gd_get32(data, pos, frame.map) || !gd_get32(data, pos, frame.scalars))
+                return false;
+        if (!gd_get32(data, pos, size) || size > data.size() - pos)
+            return false;
+        run.changes.assign(data.begin() + pos, data.begin() + pos + size);
+        pos += size;
+        new_runs.push_back(std::move(run));
+    }
+
+    runs = std::move(new_runs);
+    return true;
+}
+
+
+/// Play all caves and replays of the cavesets, and record the hashes of every frame.
+/// Every replay is played as with gd_replay_play_headless(). Every cave is also played
+/// on the first level for the given number of frames, with the movements of ScriptedInput.
+/// The runs are distributed among a pool of worker threads.
+/// @param cavesets The cavesets to play.
+/// @param script_frames The number of frames to play the caves with scripted movements; 0 to play only the replays.
+/// @param cells Also record the cells changed in each frame, so a divergence can be located.
+/// @param threads The number of worker threads, 0 to use all processors.
+/// @param full_scan Scan every cell of the caves in each iteration, as the game does, instead
+///     of skipping the idle ones. The hashes do not depend on this, so the same golden file
+///     can be checked both ways.
+/// @return The runs, in the order of the cavesets, caves and replays.
+std::vector<GoldenRun> gd_golden_play(std::vector<CaveSet> const &cavesets, int script_frames, bool cells, unsigned threads, bool full_scan) {
+    struct Job {
+        CaveStored const *cave;
+        CaveReplay const *replay;       ///< NULL for scripted movements
+    };
+    std::vector<Job> jobs;
+    std::vector<GoldenRun> runs;
+
+    /* the keys name the cavesets relative to the current directory, so golden files can be moved */
+    AutoGFreePtr<char> cwd(g_get_current_dir());
+    std::string prefix = std::string((char *) cwd) + G_DIR_SEPARATOR_S;
+    for (auto const &caveset : cavesets) {
+        std::string filename = caveset.filename;
+        if (filename.compare(0, prefix.size(), prefix) == 0)
+            filename.erase(0, prefix.size());
+        for (auto const &cave : caveset.caves) {
+            if (script_frames > 0) {
+                jobs.push_back(Job{&cave, NULL});
+                runs.push_back(GoldenRun());
+                runs.back().key = Printf("%s|%s|script %d", filename, cave.name, script_frames);
+            }
+            int number = 0;
+            for (auto const &replay : cave.replays) {
+                jobs.push_back(Job{&cave, &replay});
+                runs.push_back(GoldenRun());
+                runs.back().key = Printf("%s|%s|replay %d|level %d|seed %d", filename, cave.name, ++number, replay.level, replay.seed);
+            }
+        }
+    }
+
+    gd_parallel_for(jobs.size(), threads, [&](unsigned i) {
+        Job const &job = jobs[i];
+        if (job.replay == NULL) {
+            CaveRendered rendered(*job.cave, 0, 0);
+            rendered.setup_for_game();
+            rendered.active_cell_scan = !full_scan;
+            GoldenRecorder recorder(runs[i], rendered, cells);
+            ScriptedInput input;
+            for (int frame = 0; frame < script_frames; ++frame) {
+                GdDirectionEnum player_move;
+                bool fire;
+                input.next(player_move, fire);
+                rendered.iterate(player_move, fire, false);
+                rendered.particles.clear();
+                recorder.frame_done(rendered);
+            }
+        } else {
+            CaveReplay playing(*job.replay);
+            CaveRendered rendered(*job.cave, playing.level - 1, playing.seed);
+            rendered.setup_for_game();
+            rendered.active_cell_scan = !full_scan;
+            playing.rewind();
+            GoldenRecorder recorder(runs[i], rendered, cells);
+            gd_replay_play_headless_from(rendered, playing, ReplayResult(), [&recorder](CaveRendered const &cave) {
+                recorder.frame_done(cave);
+            });
+        }
+    });
+
+    return runs;
+}
+
+
+/// Compare runs to the golden runs, and print a report of the differences to the standard output.
+/// Runs are matched by their keys. For every run which differs, the first
+/// frame which has a different hash is reported. If the golden runs and the
+/// new runs both have the changed cells recorded, the first cell which is
+/// different is also reported.
+/// @return The number of runs which differ.
+int gd_golden_compare(std::vector<GoldenRun> const &golden, std::vector<GoldenRun> const &runs) {
+    std::map<std::string, GoldenRun const *> golden_by_key;
+    for (auto const &run : golden)
+        golden_by_key[run.key] = &run;
+
+    int ok = 0, diverged = 0, new_runs = 0;
+    long long frames = 0;
+    for (auto const &run : runs) {
+        frames += run.frames.size();
+        auto it = golden_by_key.find(run.key);
+        if (it == golden_by_key.end()) {
+            g_print("%s", Printf("%-8s %s: %d frames\n", "NEW", run.key, run.frames.size()).c_str());
+            new_runs++;
+            continue;
+        }
+        GoldenRun const &expected = *it->second;
+        golden_by_key.erase(it);
+
+        size_t common = std::min(expected.frames.size(), run.frames.size());
+        size_t frame = std::mismatch(expected.frames.begin(), expected.frames.begin() + common, run.frames.begin()).first - expected.frames.begin();
+        if (frame < common) {
+            g_print("%s", Printf("%-8s %s: %s\n", "DIVERGED", run.key, describe_divergence(expected, run, frame)).c_str());
+            diverged++;
+        } else if (expected.frames.size() != run.frames.size()) {
+            g_print("%s", Printf("%-8s %s: %d frames, expected %d\n", "LENGTH", run.key, run.frames.size(), expected.frames.size()).c_str());
+            diverged++;
+        } else
+            ok++;
+    }
+    g_print("%s", Printf("%d runs, %d frames: %d ok, %d diverged, %d new; %d runs of the golden file not played\n",
+                         runs.size(), frames, ok, diverged, new_runs, golden_by_key.size()).c_str());
+    return diverged;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef GOLDENHASH_HPP_INCLUDED
+#define GOLDENHASH_HPP_INCLUDED
+
+#include "config.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class CaveSet;
+class CaveRendered;
+
+/// @ingroup Cave
+/// Hash of the state of a cave after an iteration.
+/// The map and the other variables are hashed separately, so a divergence
+/// can be attributed to one of them.
+struct FrameHash {
+    uint32_t map;           ///< hash of the cells of the map
+    uint32_t scalars;       ///< hash of score, time, player and the other variables of the cave
+
+    bool operator==(FrameHash const &other) const {
+        return map == other.map && scalars == other.scalars;
+    }
+    bool operator!=(FrameHash const &other) const {
+        return !(*this == other);
+    }
+};
+
+FrameHash gd_cave_frame_hash(CaveRendered const &cave);
+
+/// @ingroup Cave
+/// The hashes of a cave after every iteration, when played with a replay
+/// or with scripted movements.
+struct GoldenRun {
+    std::string key;                        ///< names the caveset, the cave and the movements played
+    int width = 0;                          ///< width of the cave, to find the coordinates of changed cells
+    std::vector<FrameHash> frames;          ///< hash after each iteration
+    std::vector<unsigned char> changes;     ///< the cells changed in each frame; empty if not recorded
+};
+
+std::vector<unsigned char> gd_golden_save(std::vector<GoldenRun> const &runs);
+bool gd_golden_load(std::vector<unsigned char> const &data, std::vector<GoldenRun> &runs);
+std::vector<GoldenRun> gd_golden_play(std::vector<CaveSet> const &cavesets, int script_frames, bool cells, unsigned threads, bool full_scan = false);
+int gd_golden_compare(std::vector<GoldenRun> const &golden, std::vector<GoldenRun> const &runs);
+
+#endif
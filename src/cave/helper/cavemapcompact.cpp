@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <algorithm>
+
+#include "cave/helper/cavemapcompact.hpp"
+
+
+/// Set size of map; fill all with def.
+void CaveMapCompact::set_size(int new_w, int new_h, GdElementEnum def) {
+    if (new_w != w || new_h != h) {
+        w = new_w;
+        h = new_h;
+        stride = w + 2 * Border;
+        data.assign(stride * (h + 2 * Border), uint16_t(def));
+        active.assign(data.size() / 64 + 1, ~uint64_t(0));
+        for (int dir = MV_STILL; dir <= MV_UP_LEFT_2; ++dir)
+            offsets[dir] = gd_dx[dir] + gd_dy[dir] * stride;
+        create_table();
+    } else
+        fill(def);
+}
+
+
+/// Fill the whole map with an element.
+void CaveMapCompact::fill(GdElementEnum value) {
+    std::fill(data.begin(), data.end(), uint16_t(value));
+    std::fill(active.begin(), active.end(), ~uint64_t(0));
+}
+
+
+/// Copy the elements of a CaveMap to this map, which is resized if needed.
+/// The wrap type is not changed.
+void CaveMapCompact::assign(CaveMap<GdElementEnum> const &map) {
+    set_size(map.width(), map.height());
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x)
+            data[(y + Border) * stride + (x + Border)] = uint16_t(map(x, y));
+    std::fill(active.begin(), active.end(), ~uint64_t(0));
+    refresh_ghosts();
+}
+
+
+/// Create a CaveMap with the same elements, for the editor and for saving.
+CaveMap<GdElementEnum> CaveMapCompact::to_cave_map() const {
+    CaveMap<GdElementEnum> map(w, h);
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x)
+            map(x, y) = at((y + Border) * stride + (x + Border));
+    return map;
+}
+
+
+/// Select perfect or lineshifting borders, or range checking.
+/// The ghost cells are updated accordingly.
+void CaveMapCompact::set_wrap_type(CaveMapFuncs::WrapType t) {
+    wrap_type = t;
+    reach = (t == CaveMapFuncs::RangeCheck) ? 0 : Border;
+    create_table();
+}
+
+
+/// Wrap coordinates which are outside the cave, as CaveMap would do.
+/// @return The index of the real cell in the buffer.
+int CaveMapCompact::index_far(int x, int y) const {
+    switch (wrap_type) {
+        case CaveMapFuncs::RangeCheck:
+            CaveMapFuncs::range_check_coords(w, h, x, y);
+            break;
+        case CaveMapFuncs::Perfect:
+            CaveMapFuncs::perfect_wrap_coords(w, h, x, y);
+            break;
+        case CaveMapFuncs::LineShift:
+            CaveMapFuncs::lineshift_wrap_coords_both(w, h, x, y);
+            /* for x=-w, -2w... the wrapping function gives x=w, which CaveMap reads as the first cell of the next row */
+            if (x == w) {
+                x = 0;
+                y = (y + 1) % h;
+            }
+            break;
+    }
+    return (y + Border) * stride + (x + Border);
+}
+
+
+/// The index of the real cell shown at index i, which is marked as an edge cell.
+int CaveMapCompact::home_far(int i) const {
+    return index_far(x_of(i), y_of(i));
+}
+
+
+/// Store an element to a cell at the edge of the cave, or to a ghost cell;
+/// the real cell and all of its ghost copies are updated.
+void CaveMapCompact::set_edge(int i, GdElementEnum element) {
+    int cell = home_far(i);
+    data[cell] = element;
+    active[cell >> 6] |= uint64_t(1) << (cell & 63);
+    auto range = std::equal_range(ghosts->begin(), ghosts->end(), std::make_pair(cell, 0),
+        [](std::pair<int, int> const &a, std::pair<int, int> const &b) {
+            return a.first < b.first;
+        });
+    for (auto it = range.first; it != range.second; ++it)
+        data[it->second] = element;
+}
+
+
+/// Find the ghost cells for the current size and wrap type, mark the edge
+/// cells, and copy the real cells to the ghost cells.
+void CaveMapCompact::create_table() {
+    std::shared_ptr<GhostTable> t = std::make_shared<GhostTable>();
+    int size = data.size();
+
+    edge.assign(size / 64 + 1, 0);
+    if (wrap_type != CaveMapFuncs::RangeCheck) {
+        for (int i = 0; i < size; ++i) {
+            int x = x_of(i), y = y_of(i);
+            if (x < 0 || x >= w || y < 0 || y >= h) {
+                int cell = index_far(x, y);
+                t->push_back(std::make_pair(cell, i));
+                edge[i >> 6] |= uint64_t(1) << (i & 63);
+                edge[cell >> 6] |= uint64_t(1) << (cell & 63);
+            }
+        }
+        std::sort(t->begin(), t->end());
+    }
+
+    ghosts = std::move(t);
+    refresh_ghosts();
+}
+
+
+/// Copy all real cells to their ghost cells.
+void CaveMapCompact::refresh_ghosts() {
+    if (!ghosts)
+        return;
+    for (auto const &g : *ghosts)
+        data[g.second] = data[g.first];
+}
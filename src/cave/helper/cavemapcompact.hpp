@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef CAVEMAPCOMPACT_HPP_INCLUDED
+#define CAVEMAPCOMPACT_HPP_INCLUDED
+
+#include "config.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "cave/cavetypes.hpp"
+#include "cave/cavebase.hpp"
+#include "cave/helper/cavemap.hpp"
+
+/**
+ * The map of a cave as used by the game engine.
+ *
+ * Elements are stored as 16-bit codes in a flat buffer. The buffer has a
+ * ring of ghost cells around the cave, Border cells wide. Each ghost cell
+ * holds a copy of the cell which is reached by wrapping around the edges of
+ * the cave (perfect or lineshifting borders). So reading a neighbour of any
+ * cell of the cave needs no wrapping arithmetic: it is at the index of the
+ * cell plus the offset of the direction, see neighbour().
+ *
+ * Writes always go to the real cell, and then to all of its ghost copies,
+ * so the ghost ring is always up to date, and the order of the cave scan
+ * sees exactly the same elements as with a CaveMap. Only the cells at the
+ * edges of the cave have ghost copies; they are marked in a bitmap, so
+ * writing any other cell is a single store.
+ *
+ * Every write also marks the real cell active. The game engine can clear
+ * this mark for cells which need no processing, and visit only the active
+ * cells in the next scan; see CaveRendered::active_cell_scan.
+ *
+ * Coordinates farther off the cave than Border are wrapped the slow way.
+ * With range checking, there are no ghost cells, and accessing a cell
+ * outside the cave throws std::out_of_range, as with CaveMap.
+ */
+class CaveMapCompact: public CaveMapFuncs {
+public:
+    /// Width of the ghost ring around the cave.
+    enum { Border = 2 };
+
+private:
+    /// The ghost cells of the real cells, as (real cell, ghost cell) index pairs, sorted.
+    /// They depend only on the size and the wrap type, so they are shared among the copies of the map.
+    typedef std::vector<std::pair<int, int>> GhostTable;
+
+    int w = 0, h = 0;
+    int stride = 0;                     ///< Width of a row in the buffer.
+    int reach = 0;                      ///< Coordinates up to this far off the cave have a ghost cell. Border, or zero for range checking.
+    CaveMapFuncs::WrapType wrap_type = CaveMapFuncs::RangeCheck;
+    int offsets[MV_UP_LEFT_2 + 1] = {}; ///< The difference of the index of a cell and its neighbour, for each direction.
+    std::vector<uint16_t> data;
+    std::vector<uint64_t> active;       ///< One bit for each index in the buffer; set when the real cell is written.
+    std::vector<uint64_t> edge;         ///< One bit for each index in the buffer; set for ghost cells, and for the real cells which have ghosts.
+    std::shared_ptr<GhostTable const> ghosts;
+
+    void create_table();
+    void refresh_ghosts();
+    int index_far(int x, int y) const;
+    int home_far(int i) const;
+    void set_edge(int i, GdElementEnum element);
+    bool is_edge(int i) const {
+        return ((edge[i >> 6] >> (i & 63)) & 1) != 0;
+    }
+
+public:
+    CaveMapCompact() = default;
+    void set_size(int new_w, int new_h, GdElementEnum def = GdElementEnum());
+    void fill(GdElementEnum value);
+    void assign(CaveMap<GdElementEnum> const &map);
+    CaveMap<GdElementEnum> to_cave_map() const;
+    bool empty() const {
+        return w == 0 || h == 0;
+    }
+    int width() const {
+        return w;
+    }
+    int height() const {
+        return h;
+    }
+
+    void set_wrap_type(CaveMapFuncs::WrapType t);
+
+    /// Index of the cell at (x,y) in the buffer. Might be the index of a ghost cell.
+    int index(int x, int y) const {
+        if (unsigned(x + reach) < unsigned(w + 2 * reach) && unsigned(y + reach) < unsigned(h + 2 * reach))
+            return (y + Border) * stride + (x + Border);
+        return index_far(x, y);
+    }
+    /// Index of the neighbour of the cell at index i, in the given direction.
+    /// The cell must be one of the cave, not a ghost cell, and the map must have
+    /// a ghost ring (not range checking); then the neighbour is always in the buffer.
+    int neighbour(int i, GdDirectionEnum dir) const {
+        return i + offsets[dir];
+    }
+    /// Index of the cell at (x,y)+dir. If (x,y) is in the cave, and the map has a ghost
+    /// ring, this is a single offset add; otherwise the coordinates are wrapped.
+    int index(int x, int y, GdDirectionEnum dir) const {
+        if (unsigned(x) < unsigned(w) && unsigned(y) < unsigned(h) && reach != 0)
+            return neighbour((y + Border) * stride + (x + Border), dir);
+        return index(x + gd_dx[dir], y + gd_dy[dir]);
+    }
+    /// Element at the index returned by index().
+    GdElementEnum at(int i) const {
+        return GdElementEnum(data[i]);
+    }
+    /// Store an element at the index returned by index(); ghost copies are also updated.
+    void set_at(int i, GdElementEnum element) {
+        if (is_edge(i))
+            set_edge(i, element);
+        else {
+            data[i] = element;
+            active[i >> 6] |= uint64_t(1) << (i & 63);
+        }
+    }
+
+    /// Index of the real cell shown at index i. The same as i for the cells of the cave.
+    /// Indices of real cells are in the order of rows, then columns.
+    int home(int i) const {
+        return is_edge(i) ? home_far(i) : i;
+    }
+    /// Coordinates of the real cell at index i.
+    int x_of(int i) const {
+        return i % stride - Border;
+    }
+    int y_of(int i) const {
+        return i / stride - Border;
+    }
+
+    /// The cells of row y of the cave, without the ghost cells around it.
+    /// Used to process the whole map fast.
+    uint16_t const *row(int y) const {
+        return &data[(y + Border) * stride + Border];
+    }
+
+    /// Clear the active mark of a cell; it will be set again when the cell is written.
+    void set_inactive(int i) {
+        active[i >> 6] &= ~(uint64_t(1) << (i & 63));
+    }
+    /// Find the first active cell at index i or after, but before end.
+    /// @return The index of the cell, or end if there is none.
+    int next_active(int i, int end) const {
+        while (i < end) {
+            uint64_t bits = active[i >> 6] >> (i & 63);
+            if (bits != 0) {
+                i += __builtin_ctzll(bits);
+                return i < end ? i : end;
+            }
+            i = (i | 63) + 1;
+        }
+        return end;
+    }
+
+    GdElementEnum operator()(int x, int y) const {
+        return at(index(x, y));
+    }
+    void set(int x, int y, GdElementEnum element) {
+        set_at(index(x, y), element);
+    }
+};
+
+#endif
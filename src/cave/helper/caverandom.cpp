@@ -25,7 +25,11 @@
 
 #include <glib.h>
 #include <algorithm>
+#include <climits>
+#include <vector>
+#include <chrono>
 #include "cave/helper/caverandom.hpp"
+#include "misc/printf.hpp"
 
 /// Constructor. Initializes generator to a random series.
 C64RandomGenerator::C64RandomGenerator() {
@@ -54,3 +58,76 @@ unsigned int C64RandomGenerator::random() {
 
     return rand_seed_1;
 }
+
+
+/// Compare RandomGenerator to the GRand of GLib.
+/// A generator is created for every cave seed, and numbers are drawn from it
+/// and from a GRand with the same seed, in the ways the engine does: ranges
+/// used by the caves, larger ranges, booleans and plain integers. Halfway
+/// through every seed, the generator is also restored from its saved state.
+/// The results and the time taken by both generators are printed.
+/// @param draws The number of draws in total; at least one for every seed.
+/// @return true, if all numbers were the same.
+bool gd_random_check_glib(unsigned long draws) {
+    static const struct {
+        int begin, end;
+    } ranges[] = {
+        {0, 1000000},       /* probabilities */
+        {0, 4}, {0, 8}, {0, 2}, {0, 3}, {0, 100}, {-5, 5},
+        {0, GD_CAVE_SEED_MAX},
+        {0, INT_MAX},
+        {-0x40000000, 0x50000000},  /* more than 2^31 apart */
+        {INT_MIN, INT_MAX},
+    };
+    unsigned long const seeds = GD_CAVE_SEED_MAX + 1;
+    unsigned long const per_seed = std::max(draws / seeds, 1ul);
+    unsigned long mismatches = 0;
+    std::chrono::steady_clock::duration ours(0), glib(0);
+
+    for (unsigned long seed = 0; seed < seeds; ++seed) {
+        RandomGenerator gen(seed);
+        GRand *grand = g_rand_new_with_seed(seed);
+        std::vector<guint32> expected(per_seed), got(per_seed);
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < per_seed; ++i) {
+            if (i % 11 == 10)
+                expected[i] = g_rand_int(grand);
+            else if (i % 7 == 6)
+                expected[i] = g_rand_boolean(grand);
+            else
+                expected[i] = g_rand_int_range(grand, ranges[i % G_N_ELEMENTS(ranges)].begin, ranges[i % G_N_ELEMENTS(ranges)].end);
+        }
+        auto mid = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < per_seed; ++i) {
+            if (i == per_seed / 2) {
+                RandomGenerator restored;
+                restored.set_state(gen.get_state());
+                gen = restored;
+            }
+            if (i % 11 == 10)
+                got[i] = gen.rand_int();
+            else if (i % 7 == 6)
+                got[i] = gen.rand_boolean();
+            else
+                got[i] = gen.rand_int_range(ranges[i % G_N_ELEMENTS(ranges)].begin, ranges[i % G_N_ELEMENTS(ranges)].end);
+        }
+        auto end = std::chrono::steady_clock::now();
+        glib += mid - start;
+        ours += end - mid;
+        g_rand_free(grand);
+
+        if (got != expected) {
+            if (mismatches == 0)
+                g_print("%s", Printf("Random generator differs from GLib for seed %d\n", seed).c_str());
+            mismatches++;
+        }
+    }
+
+    unsigned long total = per_seed * seeds;
+    g_print("%s", Printf("Random generator: %d seeds, %d draws, %d mismatching seeds; %.2f ns/draw, GLib %.2f ns/draw\n",
+                         seeds, total, mismatches,
+                         std::chrono::duration<double, std::nano>(ours).count() / total,
+                         std::chrono::duration<double, std::nano>(glib).count() / total).c_str());
+    return mismatches == 0;
+}
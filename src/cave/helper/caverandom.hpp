@@ -32,69 +32,132 @@
 enum { GD_CAVE_SEED_MAX = 65535 };
 
 /**
- * @brief Wraps a GLib random generator to make it a C++ class.
+ * @brief The random generator of GLib's GRand, as a C++ class.
  *
  * This is the main random generator, which is used during
  * playing the cave. The C64 random generator is only used when
  * creating the cave.
+ *
+ * It is a Mersenne Twister, which gives exactly the same numbers as
+ * g_rand_int(), g_rand_int_range() and g_rand_boolean() of a GRand
+ * created with the same seed (using the GLib 2.2+ algorithms, which are
+ * the default). Replays depend on this. The state is stored by value,
+ * so copying the generator along with a cave needs no allocation.
+ * gd_random_check_glib() can be used to compare it to GLib.
  */
 class RandomGenerator {
+public:
+    /// The internal state of the generator, to save and restore a game.
+    /// The same as in GRand: the state vector and the index in it.
+    struct State {
+        guint32 mt[624];
+        guint mti;
+    };
+
 private:
-    /// The GRand wrapped - stores the internal state.
-    GRand *rand;
+    enum {
+        N = 624,
+        M = 397,
+    };
+    static const guint32 matrix_a = 0x9908b0df;
+    static const guint32 upper_mask = 0x80000000;
+    static const guint32 lower_mask = 0x7fffffff;
+
+    /// The internal state.
+    State state;
+
+    /// Generate the next N numbers of the state vector.
+    void next_state() {
+        guint32 *mt = state.mt;
+        int kk;
+        for (kk = 0; kk < N - M; kk++) {
+            guint32 y = (mt[kk] & upper_mask) | (mt[kk + 1] & lower_mask);
+            mt[kk] = mt[kk + M] ^ (y >> 1) ^ ((y & 1) ? matrix_a : 0);
+        }
+        for (; kk < N - 1; kk++) {
+            guint32 y = (mt[kk] & upper_mask) | (mt[kk + 1] & lower_mask);
+            mt[kk] = mt[kk + (M - N)] ^ (y >> 1) ^ ((y & 1) ? matrix_a : 0);
+        }
+        guint32 y = (mt[N - 1] & upper_mask) | (mt[0] & lower_mask);
+        mt[N - 1] = mt[M - 1] ^ (y >> 1) ^ ((y & 1) ? matrix_a : 0);
+        state.mti = 0;
+    }
 
 public:
     /// Create object; initialize randomly
     RandomGenerator() {
-        rand = g_rand_new();
+        set_seed(g_random_int());
     }
 
     /// Create object.
     /// @param seed Random number seed to be used.
     explicit RandomGenerator(unsigned int seed) {
-        rand = g_rand_new_with_seed(seed);
-    }
-
-    RandomGenerator(const RandomGenerator & other) {
-        rand = g_rand_copy(other.rand);
-    }
-    RandomGenerator(RandomGenerator && other) {
-        rand = other.rand;
-        other.rand = NULL;
-    }
-    RandomGenerator &operator=(RandomGenerator rhs) {
-        std::swap(rand, rhs.rand);
-        return *this;
-    }
-    ~RandomGenerator() {
-        if (rand != NULL)
-            g_rand_free(rand);
+        set_seed(seed);
     }
 
     /// Set seed to given number, to generate a series of random numbers.
     /// @param seed The seed value.
     void set_seed(unsigned int seed) {
-        g_rand_set_seed(rand, seed);
+        state.mt[0] = seed;
+        for (state.mti = 1; state.mti < N; state.mti++)
+            state.mt[state.mti] = 1812433253UL * (state.mt[state.mti - 1] ^ (state.mt[state.mti - 1] >> 30)) + state.mti;
     }
-    
+
+    /// Generate a random 32-bit unsigned integer.
+    unsigned int rand_int() {
+        if (state.mti >= N)
+            next_state();
+        guint32 y = state.mt[state.mti++];
+        /* tempering */
+        y ^= y >> 11;
+        y ^= (y << 7) & 0x9d2c5680;
+        y ^= (y << 15) & 0xefc60000;
+        y ^= y >> 18;
+        return y;
+    }
+
     /// Generater a random boolean. 50% false, 50% true.
     bool rand_boolean() {
-        return g_rand_boolean(rand) != FALSE;
+        return (rand_int() & (1 << 15)) != 0;
     }
 
     /// Generate a random integer, [begin, end).
     /// @param begin Start of interval, inclusive.
     /// @param end End of interval, non-inclusive.
     int rand_int_range(int begin, int end) {
-        return g_rand_int_range(rand, begin, end);
+        if (end <= begin)
+            return begin;
+        guint32 dist = guint32(end) - guint32(begin);
+        /* the numbers above the largest multiple of dist are dropped, so all results are equally likely */
+        guint32 maxvalue;
+        if (dist <= 0x80000000u) {
+            /* maxvalue = 2^32 - 1 - (2^32 % dist) */
+            guint32 leftover = (0x80000000u % dist) * 2;
+            if (leftover >= dist)
+                leftover -= dist;
+            maxvalue = 0xffffffffu - leftover;
+        } else
+            maxvalue = dist - 1;
+        guint32 random;
+        do
+            random = rand_int();
+        while (random > maxvalue);
+        return int(guint32(begin) + random % dist);
     }
 
-    /// Generate a random 32-bit unsigned integer.
-    unsigned int rand_int() {
-        return g_rand_int(rand);
+    /// Get the internal state.
+    State const &get_state() const {
+        return state;
+    }
+
+    /// Restore an internal state got with get_state().
+    void set_state(State const &newstate) {
+        state = newstate;
     }
 };
 
+bool gd_random_check_glib(unsigned long draws);
+
 /**
  * @brief Random number generator, which is compatible with the original game.
  *
@@ -127,6 +190,12 @@ public:
         rand_seed_2 = seed % 256;
     }
 
+    /// Get the current seed, which is the whole internal state.
+    /// @return The two bytes of seed, as for set_seed(int).
+    int get_seed() const {
+        return rand_seed_1 * 256 + rand_seed_2;
+    }
+
     unsigned int random();
 };
 
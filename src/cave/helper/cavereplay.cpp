@@ -23,6 +23,7 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <vector>
 #include <sstream>
 #include <cstdio>
@@ -90,6 +91,19 @@ void CaveReplay::rewind() {
     current_playing_pos = 0;
 }
 
+/* continue playing from the given movement */
+void CaveReplay::seek(unsigned int pos) {
+    current_playing_pos = std::min<unsigned int>(pos, movements.size());
+}
+
+/* forget the movements after the given length; for example when the game is rewound */
+void CaveReplay::truncate(unsigned int length) {
+    if (length < movements.size())
+        movements.resize(length);
+    if (current_playing_pos > movements.size())
+        current_playing_pos = movements.size();
+}
+
 bool CaveReplay::load_one_from_bdcff(const std::string &str) {
     bool up, down, left, right;
     bool fire, suicide;
@@ -58,9 +58,15 @@ public:
     void store_movement(GdDirectionEnum player_move, bool player_fire, bool suicide);
     bool get_next_movement(GdDirectionEnum &player_move, bool &player_fire, bool &suicide);
     void rewind();
+    void seek(unsigned int pos);
+    void truncate(unsigned int length);
     unsigned int length() const {
         return movements.size();
     }
+    /// The number of movements already read by get_next_movement().
+    unsigned int position() const {
+        return current_playing_pos;
+    }
 
     GdInt level;            ///< replay for level n
     GdInt seed;                ///< seed the cave is to be rendered with
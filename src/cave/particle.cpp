@@ -25,47 +25,178 @@
 
 #include "cave/particle.hpp"
 
-ParticleSet::ParticleSet(int count, float size, float opacity, float p0x, float p0y, float dp0x, float dp0y, float v0x, float v0y, float dvx, float dvy, const GdColor &color)
-    : color(color)
-    , life(1000)
-    , is_new(true)
-    , size(size)
-    , opacity(opacity)
-    , particles(count) {
-    for (size_t i = 0; i < particles.size(); ++i) {
-        Particle &p = particles[i];
-        p.px = p0x + g_random_double_range(-dp0x, dp0x);
-        p.py = p0y + g_random_double_range(-dp0y, dp0y);
-        p.vx = v0x + g_random_double_range(-dvx, dvx);
-        p.vy = v0y + g_random_double_range(-dvy, dvy);
+ParticlePool::ParticlePool()
+    : oldest_set(0)
+    , num_sets_alive(0)
+    , next_particle(0)
+    , num_particles_alive(0)
+    , random_state(0)
+    , allocation_count(0)
+    , dropped_count(0) {
+    /* the storage is allocated when the first particle set is added.
+     * most cave objects (in the editor, in replay checks...) never get one. */
+}
+
+
+ParticlePool::ParticlePool(ParticlePool const &other)
+    : ParticlePool() {
+    *this = other;
+}
+
+
+ParticlePool &ParticlePool::operator=(ParticlePool const &other) {
+    if (this == &other)
+        return *this;
+    if (other.empty()) {
+        clear();
+        return *this;
     }
+    px = other.px;
+    py = other.py;
+    vx = other.vx;
+    vy = other.vy;
+    sets = other.sets;
+    oldest_set = other.oldest_set;
+    num_sets_alive = other.num_sets_alive;
+    next_particle = other.next_particle;
+    num_particles_alive = other.num_particles_alive;
+    random_state = other.random_state;
+    allocation_count = other.allocation_count;
+    dropped_count = other.dropped_count;
+    return *this;
 }
 
 
-void ParticleSet::move(int dt_ms) {
-    float dt = dt_ms / 1000.0;
+void ParticlePool::allocate() {
+    px.resize(MaxParticles);
+    py.resize(MaxParticles);
+    vx.resize(MaxParticles);
+    vy.resize(MaxParticles);
+    sets.resize(MaxSets);
+    random_state = g_random_int() | 1;  /* xorshift state must not be zero */
+    ++allocation_count;
+}
+
+
+void ParticlePool::drop_oldest() {
+    num_particles_alive -= sets[oldest_set].count;
+    oldest_set = (oldest_set + 1) % MaxSets;
+    --num_sets_alive;
+    if (num_sets_alive == 0)
+        next_particle = 0;
+}
+
+
+void ParticlePool::add(int count, float size, float opacity, float p0x, float p0y, float dp0x, float dp0y, float v0x, float v0y, float dvx, float dvy, const GdColor &color) {
+    if (count <= 0)
+        return;
+    if (count > MaxParticles)
+        count = MaxParticles;
+    if (sets.empty())
+        allocate();
+
+    /* the particles of a set are stored contiguously. if they do not fit
+     * before the end of the arrays, start again from the beginning - but first
+     * remove the sets which are still stored there at the end. */
+    if (next_particle + count > MaxParticles) {
+        while (num_sets_alive > 0 && sets[oldest_set].first >= next_particle) {
+            drop_oldest();
+            ++dropped_count;
+        }
+        next_particle = 0;
+    }
+    /* sets are stored in order of their age, so only the oldest ones can be
+     * in the way of the new one. */
+    while (num_sets_alive > 0) {
+        ParticleSet const &oldest = sets[oldest_set];
+        if (oldest.first >= next_particle + count || oldest.first + oldest.count <= next_particle)
+            break;
+        drop_oldest();
+        ++dropped_count;
+    }
+    if (num_sets_alive == MaxSets) {
+        drop_oldest();
+        ++dropped_count;
+    }
 
-    for (size_t i = 0; i < particles.size(); ++i) {
-        Particle &p = particles[i];
-        p.px += p.vx * dt;
-        p.py += p.vy * dt;
+    unsigned first = next_particle;
+    ParticleSet &ps = sets[(oldest_set + num_sets_alive) % MaxSets];
+    ps.first = first;
+    ps.count = count;
+    ps.color = color;
+    ps.life = 1000;
+    ps.is_new = true;
+    ps.size = size;
+    ps.opacity = opacity;
+    for (unsigned i = first; i < first + count; ++i) {
+        px[i] = p0x + random_range(dp0x);
+        py[i] = p0y + random_range(dp0y);
+        vx[i] = v0x + random_range(dvx);
+        vy[i] = v0y + random_range(dvy);
     }
+    ++num_sets_alive;
+    num_particles_alive += count;
+    next_particle = first + count;
+}
+
 
-    life -= dt_ms;
+/// Move the particles between the given indices.
+/// A plain loop over the arrays, so it can be vectorized.
+static void move_range(float *px, float *py, float const *vx, float const *vy, unsigned begin, unsigned end, float dt) {
+    for (unsigned i = begin; i < end; ++i) {
+        px[i] += vx[i] * dt;
+        py[i] += vy[i] * dt;
+    }
 }
 
 
-void ParticleSet::normalize(double factor) {
-    if (!is_new)
+void ParticlePool::move(int dt_ms) {
+    if (num_sets_alive == 0)
         return;
-    is_new = false;
-
-    size *= factor;
-    for (size_t i = 0; i < particles.size(); ++i) {
-        Particle &p = particles[i];
-        p.px *= factor;
-        p.py *= factor;
-        p.vx *= factor;
-        p.vy *= factor;
+
+    float dt = dt_ms / 1000.0f;
+    /* the particles alive are from the first one of the oldest set up to
+     * next_particle, maybe wrapping around the end of the arrays. after the
+     * end of the newest set there might be some unused ones; moving them
+     * too is cheaper than checking. */
+    unsigned begin = sets[oldest_set].first;
+    if (begin < next_particle)
+        move_range(&px[0], &py[0], &vx[0], &vy[0], begin, next_particle, dt);
+    else {
+        move_range(&px[0], &py[0], &vx[0], &vy[0], begin, MaxParticles, dt);
+        move_range(&px[0], &py[0], &vx[0], &vy[0], 0, next_particle, dt);
     }
+
+    for (size_t i = 0; i < num_sets_alive; ++i)
+        sets[(oldest_set + i) % MaxSets].life -= dt_ms;
+    /* all sets age the same, so the expired ones are the oldest ones. */
+    while (num_sets_alive > 0 && sets[oldest_set].life < 0)
+        drop_oldest();
+}
+
+
+void ParticlePool::normalize(double factor) {
+    for (size_t s = 0; s < num_sets_alive; ++s) {
+        ParticleSet &ps = sets[(oldest_set + s) % MaxSets];
+        if (!ps.is_new)
+            continue;
+        ps.is_new = false;
+
+        float f = factor;
+        ps.size *= f;
+        for (unsigned i = ps.first; i < ps.first + ps.count; ++i) {
+            px[i] *= f;
+            py[i] *= f;
+            vx[i] *= f;
+            vy[i] *= f;
+        }
+    }
+}
+
+
+void ParticlePool::clear() {
+    oldest_set = 0;
+    num_sets_alive = 0;
+    next_particle = 0;
+    num_particles_alive = 0;
 }
@@ -20,69 +20,134 @@
  * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
-
 #ifndef PARTICLE_HPP_INCLUDED
 #define PARTICLE_HPP_INCLUDED
 
 #include "config.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include "cave/colors.hpp"
 
+/// A particle set: the particles created by one effect (an explosion,
+/// a falling stone etc.) They share their color, size and life.
+/// The particles themselves are stored in a ParticlePool, at the indices
+/// first .. first+count-1.
 class ParticleSet {
 public:
-    /// One single particle.
-    struct Particle {
-        float px, py;         ///< Coordinate
-        float vx, vy;         ///< Speed
-    };
+    unsigned first;     ///< Index of the first particle in the pool.
+    unsigned count;     ///< Number of particles.
+    GdColor color;
+    int life;           ///< lifetime. starts from 1000, goes to 0.
+    bool is_new;        ///< New particle set, the coordinates of which must be "normalized" to the cave screen coordinates
+    float size;         ///< Size of the particles.
+    float opacity;      ///< Opacity between 0 and 1. Values close to 1 not recommended.
+};
+
+/**
+ * Storage for all particle sets of a cave.
+ *
+ * The coordinates and the speeds of the particles are stored in separate
+ * arrays (structure of arrays), so moving them is a simple loop, which
+ * the compiler can vectorize. The storage has a fixed capacity, and it is
+ * allocated once, when the first particle set is added; adding and removing
+ * sets never allocates memory after that.
+ *
+ * All particle sets have the same lifetime, so they expire in the order
+ * they were created. Therefore both the particles and the sets are stored
+ * in ring buffers: new ones are added after the newest, and expired ones
+ * are removed from the oldest end. If there is no room for a new set,
+ * the oldest sets are dropped early.
+ */
+class ParticlePool {
+public:
+    /// Maximum number of particles alive at the same time.
+    enum { MaxParticles = 65536 };
+    /// Maximum number of particle sets alive at the same time.
+    enum { MaxSets = 4096 };
+
+    ParticlePool();
+    /// Copying an empty pool does not copy the storage, so copies of caves
+    /// without particles on the screen (snapshots, states of a search) are cheap.
+    ParticlePool(ParticlePool const &other);
+    ParticlePool &operator=(ParticlePool const &other);
 
-    /// This constructor creates a particle set, for the given cave coordinates.
+    /// Add a particle set, for the given cave coordinates.
     /// 0,0 is the top left corner of the cave; 1,1 is the bottom right corner of
     /// the top left cave cell. (So the max coordinates are the width and height
     /// of the cave.)
-    /// @param cave_x Particle set starting x coordinate in cave coordinates.
-    /// @param cave_y Particle set starting y coordinate in cave coordinates.
-    /// @param dx Half the width of the region, in which originally particles are randomly generated.
-    /// @param dy Half the height of the region, in which originally particles are randomly generated.
-    /// @param vx Maximum original speed.
-    /// @param vy Maximum original speed.
-    ParticleSet(int count, float size, float opacity, float p0x, float p0y, float dp0x, float dp0y, float v0x, float v0y, float dvx, float dvy, const GdColor &color);
-    /// Move the particles.
+    /// @param p0x Particle set starting x coordinate in cave coordinates.
+    /// @param p0y Particle set starting y coordinate in cave coordinates.
+    /// @param dp0x Half the width of the region, in which originally particles are randomly generated.
+    /// @param dp0y Half the height of the region, in which originally particles are randomly generated.
+    /// @param v0x Original speed.
+    /// @param v0y Original speed.
+    /// @param dvx Maximum random difference from the original speed.
+    /// @param dvy Maximum random difference from the original speed.
+    void add(int count, float size, float opacity, float p0x, float p0y, float dp0x, float dp0y, float v0x, float v0y, float dvx, float dvy, const GdColor &color);
+    /// Move the particles, and remove the sets which have expired.
     /// @param dt_ms Time elapsed.
     void move(int dt_ms);
-    /// Scale coordinates to screen cordinates, if is_new is true.
+    /// Scale coordinates of the new sets to screen cordinates.
     /// @param factor The number of pixels per cell on the screen.
     void normalize(double factor);
+    /// Remove all particle sets. The storage is kept.
+    void clear();
 
-    typedef std::vector<Particle> container;
-    typedef container::iterator iterator;
-    typedef container::const_iterator const_iterator;
-
-    iterator begin() {
-        return particles.begin();
-    }
-    iterator end() {
-        return particles.end();
+    bool empty() const {
+        return num_sets_alive == 0;
     }
-    const_iterator begin() const {
-        return particles.begin();
+    /// Number of particle sets alive.
+    size_t num_sets() const {
+        return num_sets_alive;
     }
-    const_iterator end() const {
-        return particles.end();
+    /// The i-th particle set alive, the oldest one being the 0th.
+    ParticleSet const &set(size_t i) const {
+        return sets[(oldest_set + i) % MaxSets];
     }
+    /// Number of particles alive.
     size_t num_particles() const {
-        return particles.size();
+        return num_particles_alive;
+    }
+    /// Coordinates of the particle at index i.
+    float x(unsigned i) const {
+        return px[i];
+    }
+    float y(unsigned i) const {
+        return py[i];
     }
 
-    GdColor color;
-    int life;           ///< lifetime. starts from 1000, goes to 0.
-    bool is_new;        ///< New particle set, the coordinates of which must be "normalized" to the cave screen coordinates
-    float size;         ///< Size of the particles.
-    float opacity;      ///< Opacity between 0 and 1. Values close to 1 not recommended.
+    /// Number of times the storage was allocated. Used by the benchmark.
+    unsigned allocations() const {
+        return allocation_count;
+    }
+    /// Number of particle sets dropped before their end of life, for
+    /// want of room. Used by the benchmark.
+    unsigned dropped() const {
+        return dropped_count;
+    }
 
 private:
-    container particles;
+    std::vector<float> px, py;      ///< Coordinates
+    std::vector<float> vx, vy;      ///< Speeds
+    std::vector<ParticleSet> sets;
+    size_t oldest_set, num_sets_alive;
+    unsigned next_particle;         ///< Index in the particle arrays, where the next set is added.
+    size_t num_particles_alive;
+    uint32_t random_state;
+    unsigned allocation_count, dropped_count;
+
+    void allocate();
+    void drop_oldest();
+    /// Random number between -range and range.
+    float random_range(float range) {
+        /* xorshift32; particles need no good random numbers, just fast ones. */
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+        return range * (int32_t(random_state) * (1.0f / 2147483648.0f));
+    }
 };
 
 #endif
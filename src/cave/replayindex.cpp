@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <glib.h>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include "cave/cavestored.hpp"
+#include "cave/caverendered.hpp"
+#include "cave/cavestate.hpp"
+#include "cave/caverewind.hpp"
+#include "cave/replayverify.hpp"
+#include "cave/helper/cavereplay.hpp"
+#include "fileops/loadfile.hpp"
+#include "misc/autogfreeptr.hpp"
+#include "misc/bytestream.hpp"
+#include "misc/parallel.hpp"
+#include "misc/printf.hpp"
+#include "settings.hpp"
+
+#include "cave/replayindex.hpp"
+
+/*
+ * The index file is little-endian binary:
+ *
+ *   "GDRI", version, interval, number of movements in the replay, number of keyframes
+ *   for each keyframe: movement, score, full (0 or 1), size of data, data
+ */
+
+namespace {
+
+char const index_magic[4] = {'G', 'D', 'R', 'I'};
+enum { INDEX_VERSION = 1 };
+
+/// Render the cave of a replay, at the start of the game.
+std::unique_ptr<CaveRendered> render_for_replay(CaveStored const &cave, CaveReplay const &replay) {
+    auto rendered = std::make_unique<CaveRendered>(cave, replay.level - 1, replay.seed);
+    rendered->setup_for_game();
+    return rendered;
+}
+
+/// Get the full state of a keyframe.
+/// @param rendered The cave at the start of the replay, if the keyframe stores changes to it.
+bool state_of_keyframe(ReplayIndex::Keyframe const &keyframe, CaveRendered const &rendered, std::vector<unsigned char> &state) {
+    if (keyframe.full) {
+        state = keyframe.data;
+        return true;
+    }
+    state = gd_cave_state_save(rendered, CaveStateInfo());
+    return RewindBuffer::apply_changes(state, keyframe.data);
+}
+
+}
+
+
+/// Create an empty index.
+/// @param interval The number of movements between keyframes.
+ReplayIndex::ReplayIndex(unsigned int interval)
+    :   interval(std::max(interval, 1u)) {
+}
+
+
+/// Start building the index.
+/// @param cave The cave at the start of the replay, set up for playing.
+void ReplayIndex::start(CaveRendered const &cave) {
+    starting_state = gd_cave_state_save(cave, CaveStateInfo());
+    keyframes.clear();
+}
+
+
+/// Add a keyframe, if it is time for one.
+/// Can be called after every movement; only every interval-th is stored.
+/// @param cave The cave after playing the movement.
+/// @param movement The number of movements played, including this one.
+/// @param score The score collected in the cave so far.
+void ReplayIndex::add(CaveRendered const &cave, unsigned int movement, int score) {
+    if (movement == 0 || movement % interval != 0)
+        return;
+    if (!keyframes.empty() && keyframes.back().movement >= movement)
+        return;
+
+    Keyframe keyframe;
+    keyframe.movement = movement;
+    keyframe.score = score;
+    std::vector<unsigned char> state = gd_cave_state_save(cave, CaveStateInfo());
+    keyframe.full = state.size() != starting_state.size();
+    if (keyframe.full)
+        keyframe.data = std::move(state);
+    else
+        RewindBuffer::encode_changes(starting_state, state, keyframe.data);
+    keyframes.push_back(std::move(keyframe));
+}
+
+
+/// Forget the keyframes after the given movement, eg. when the game was rewound.
+void ReplayIndex::truncate(unsigned int movement) {
+    while (!keyframes.empty() && keyframes.back().movement > movement)
+        keyframes.pop_back();
+}
+
+
+/// Build the index of a replay by playing it.
+/// @param cave The cave the replay was recorded in.
+/// @param replay The replay. Only a copy of it is played.
+/// @param interval The number of movements between keyframes.
+std::unique_ptr<ReplayIndex> ReplayIndex::build(CaveStored const &cave, CaveReplay const &replay, unsigned int interval) {
+    auto index = std::make_unique<ReplayIndex>(interval);
+    CaveReplay playing(replay);
+    std::unique_ptr<CaveRendered> rendered = render_for_replay(cave, playing);
+    rendered->active_cell_scan = true;
+    index->start(*rendered);
+
+    playing.rewind();
+    int score = 0;
+    GdDirectionEnum player_move;
+    bool fire, suicide;
+    /* keyframes are only needed while there are movements, and the cave is played */
+    while (rendered->player_state != GD_PL_TIMEOUT && rendered->player_state != GD_PL_EXITED
+            && playing.get_next_movement(player_move, fire, suicide)) {
+        rendered->iterate(player_move, fire, suicide);
+        score += rendered->score;
+        rendered->particles.clear();
+        if (rendered->player_state == GD_PL_DIED && fire)
+            break;
+        index->add(*rendered, playing.position(), score);
+    }
+    return index;
+}
+
+
+/// Find the keyframe to start from, to get to a movement of the replay.
+/// @return The last keyframe at or before the movement, NULL if there is none.
+ReplayIndex::Keyframe const *ReplayIndex::find(unsigned int movement) const {
+    auto it = std::upper_bound(keyframes.begin(), keyframes.end(), movement,
+                               [](unsigned int m, Keyframe const &k) { return m < k.movement; });
+    return it == keyframes.begin() ? NULL : &*(it - 1);
+}
+
+
+/// Create the cave in the state of a keyframe.
+/// The replay can be continued from the movement of the keyframe.
+/// @return The cave, or NULL if the keyframe cannot be restored; eg. it is not for this cave.
+std::unique_ptr<CaveRendered> ReplayIndex::restore(CaveStored const &cave, CaveReplay const &replay, Keyframe const &keyframe) const {
+    std::unique_ptr<CaveRendered> rendered = render_for_replay(cave, replay);
+    std::vector<unsigned char> state;
+    if (!state_of_keyframe(keyframe, *rendered, state) || !gd_cave_state_load(*rendered, state))
+        return NULL;
+    return rendered;
+}
+
+
+/// Check a segment of the replay between two keyframes.
+/// The movements are played from a keyframe (the first segment from the start of
+/// the replay), and the cave must arrive at the state of the next keyframe.
+/// @param segment The number of the segment; the index of the keyframe it ends at.
+/// @return true, if the segment and the keyframes are consistent.
+bool ReplayIndex::verify_segment(CaveStored const &cave, CaveReplay const &replay, unsigned int segment) const {
+    if (segment >= keyframes.size())
+        return false;
+
+    CaveReplay playing(replay);
+    std::unique_ptr<CaveRendered> rendered;
+    int score = 0;
+    if (segment == 0) {
+        rendered = render_for_replay(cave, replay);
+        playing.rewind();
+    } else {
+        rendered = restore(cave, replay, keyframes[segment - 1]);
+        if (!rendered)
+            return false;
+        playing.seek(keyframes[segment - 1].movement);
+        score = keyframes[segment - 1].score;
+    }
+    rendered->active_cell_scan = true;
+
+    Keyframe const &end = keyframes[segment];
+    GdDirectionEnum player_move;
+    bool fire, suicide;
+    while (playing.position() < end.movement) {
+        if (!playing.get_next_movement(player_move, fire, suicide))
+            return false;
+        rendered->iterate(player_move, fire, suicide);
+        score += rendered->score;
+        rendered->particles.clear();
+    }
+
+    std::unique_ptr<CaveRendered> start = render_for_replay(cave, replay);
+    std::vector<unsigned char> expected;
+    if (!state_of_keyframe(end, *start, expected))
+        return false;
+    return score == end.score && gd_cave_state_save(*rendered, CaveStateInfo()) == expected;
+}
+
+
+/// The memory used by the keyframes, in bytes.
+size_t ReplayIndex::memory() const {
+    size_t bytes = 0;
+    for (Keyframe const &keyframe : keyframes)
+        bytes += sizeof(keyframe) + keyframe.data.size();
+    return bytes;
+}
+
+
+/// Convert the index to the data of an index file.
+std::vector<unsigned char> ReplayIndex::save() const {
+    std::vector<unsigned char> data(index_magic, index_magic + sizeof(index_magic));
+    gd_put32(data, INDEX_VERSION);
+    gd_put32(data, interval);
+    gd_put32(data, keyframes.size());
+    for (Keyframe const &keyframe : keyframes) {
+        gd_put32(data, keyframe.movement);
+        gd_put32(data, keyframe.score);
+        gd_put32(data, keyframe.full);
+        gd_put32(data, keyframe.data.size());
+        data.insert(data.end(), keyframe.data.begin(), keyframe.data.end());
+    }
+    return data;
+}
+
+
+/// Load the index from the data of an index file.
+/// @return false, if the data is not an index file of the current version.
+bool ReplayIndex::load(std::vector<unsigned char> const &data) {
+    size_t pos = sizeof(index_magic);
+    uint32_t version, new_interval, count;
+    if (data.size() < pos || !std::equal(index_magic, index_magic + sizeof(index_magic), data.begin()))
+        return false;
+    if (!gd_get32(data, pos, version) || version != INDEX_VERSION)
+        return false;
+    if (!gd_get32(data, pos, new_interval) || new_interval == 0 || !gd_get32(data, pos, count))
+        return false;
+
+    std::vector<Keyframe> new_keyframes;
+    for (uint32_t i = 0; i < count; ++i) {
+        Keyframe keyframe;
+        uint32_t movement, score, full, size;
+        if (!gd_get32(data, pos, movement) || !gd_get32(data, pos, score) || !gd_get32(data, pos, full) || !gd_get32(data, pos, size))
+            return false;
+        if (size > data.size() - pos || (!new_keyframes.empty() && movement <= new_keyframes.back().movement))
+            return false;
+        keyframe.movement = movement;
+        keyframe.score = int32_t(score);
+        keyframe.full = full != 0;
+        keyframe.data.assign(data.begin() + pos, data.begin() + pos + size);
+        pos += size;
+        new_keyframes.push_back(std::move(keyframe));
+    }
+
+    interval = new_interval;
+    keyframes = std::move(new_keyframes);
+    starting_state.clear();
+    return true;
+}
+
+
+/// The name of the index file of a replay.
+/// It is named after the checksum of the cave, and the contents of the replay.
+std::string gd_replay_index_filename(CaveStored const &cave, CaveReplay const &replay) {
+    std::string key = Printf("%s %d %d %s", cave.name, replay.level, replay.seed, replay.movements_to_bdcff());
+    AutoGFreePtr<char> fname(g_strdup_printf("%08x-%08x.index", (unsigned) replay.checksum, g_str_hash(key.c_str())));
+    AutoGFreePtr<char> path(g_build_path(G_DIR_SEPARATOR_S, gd_user_config_dir.c_str(), "replayindex", (char *) fname, NULL));
+    return (char *) path;
+}
+
+
+/// Load the index file of a replay.
+/// @return The index, or NULL if there is no usable index for the replay.
+std::unique_ptr<ReplayIndex> gd_replay_index_load(CaveStored const &cave, CaveReplay const &replay) {
+    std::vector<unsigned char> data;
+    try {
+        data = load_file_to_vector(gd_replay_index_filename(cave, replay).c_str());
+    } catch (std::exception &e) {
+        return NULL;
+    }
+    data.pop_back();    /* the terminating zero added by the loader */
+    auto index = std::make_unique<ReplayIndex>();
+    if (!index->load(data))
+        return NULL;
+    auto const &keyframes = index->get_keyframes();
+    if (!keyframes.empty() && keyframes.back().movement > replay.length())
+        return NULL;
+    return index;
+}
+
+
+/// Save the index file of a replay.
+/// @return true, if successful.
+bool gd_replay_index_save(CaveStored const &cave, CaveReplay const &replay, ReplayIndex const &index) {
+    try {
+        save_vector_to_file(gd_replay_index_filename(cave, replay).c_str(), index.save());
+    } catch (std::exception &e) {
+        return false;
+    }
+    return true;
+}
+
+
+/// Play a replay split into segments at its keyframes, the segments in parallel.
+/// Every segment is checked with ReplayIndex::verify_segment(), and the
+/// movements after the last keyframe are played to get the result of the replay.
+/// Together this is the same as playing the replay with gd_replay_play_headless().
+/// @param threads The number of worker threads, 0 to use all processors.
+/// @param failed_segments The number of segments not consistent with the keyframes, or
+///     which could not be played, is stored here.
+/// @return The result of playing the replay.
+ReplayResult gd_replay_verify_segments(CaveStored const &cave, CaveReplay const &replay, ReplayIndex const &index, unsigned threads, int &failed_segments) {
+    auto const &keyframes = index.get_keyframes();
+    std::vector<char> segment_ok(keyframes.size() + 1);
+    ReplayResult result;
+
+    /* the last job is the rest of the replay after the last keyframe */
+    gd_parallel_for(keyframes.size() + 1, threads, [&](unsigned i) {
+        if (i < keyframes.size()) {
+            segment_ok[i] = index.verify_segment(cave, replay, i);
+            return;
+        }
+        CaveReplay playing(replay);
+        std::unique_ptr<CaveRendered> rendered;
+        ReplayResult start;
+        if (keyframes.empty()) {
+            rendered = render_for_replay(cave, replay);
+            playing.rewind();
+        } else {
+            rendered = index.restore(cave, replay, keyframes.back());
+            if (!rendered)
+                return;     /* segment_ok stays false */
+            playing.seek(keyframes.back().movement);
+            start.frames = keyframes.back().movement;
+            start.score = keyframes.back().score;
+        }
+        rendered->active_cell_scan = true;
+        result = gd_replay_play_headless_from(*rendered, playing, start);
+        segment_ok[i] = true;
+    });
+
+    failed_segments = std::count(segment_ok.begin(), segment_ok.end(), 0);
+    return result;
+}
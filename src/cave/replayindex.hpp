@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef REPLAYINDEX_HPP_INCLUDED
+#define REPLAYINDEX_HPP_INCLUDED
+
+#include "config.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class CaveStored;
+class CaveRendered;
+class CaveReplay;
+struct ReplayResult;
+
+/// @ingroup Cave
+/// Saved states of a cave at every interval-th movement of a replay.
+///
+/// With these keyframes any position of the replay can be reached by
+/// simulating at most interval frames, instead of playing the replay from
+/// the start. The segments between the keyframes can also be verified
+/// independently, eg. on different threads.
+///
+/// The keyframes are stored as the changes to the state of the cave at the
+/// start of the replay, which is rendered again when a keyframe is restored.
+/// The index is built while recording the replay, or by playing it. It is
+/// saved in a file of its own in the config directory, which is named
+/// after the replay.
+class ReplayIndex {
+public:
+    /// The default number of movements between keyframes.
+    enum { DefaultInterval = 100 };
+
+    struct Keyframe {
+        unsigned int movement;              ///< number of movements played before this state
+        int score;                          ///< score collected until this state
+        bool full;                          ///< true if data is a full state, false if changes to the starting state
+        std::vector<unsigned char> data;    ///< the state or the changes
+    };
+
+    explicit ReplayIndex(unsigned int interval = DefaultInterval);
+
+    void start(CaveRendered const &cave);
+    void add(CaveRendered const &cave, unsigned int movement, int score);
+    void truncate(unsigned int movement);
+    static std::unique_ptr<ReplayIndex> build(CaveStored const &cave, CaveReplay const &replay, unsigned int interval = DefaultInterval);
+
+    Keyframe const *find(unsigned int movement) const;
+    std::unique_ptr<CaveRendered> restore(CaveStored const &cave, CaveReplay const &replay, Keyframe const &keyframe) const;
+    bool verify_segment(CaveStored const &cave, CaveReplay const &replay, unsigned int segment) const;
+
+    /// The number of movements between keyframes.
+    unsigned int get_interval() const {
+        return interval;
+    }
+    /// The keyframes, ordered by movement.
+    std::vector<Keyframe> const &get_keyframes() const {
+        return keyframes;
+    }
+    size_t memory() const;
+
+    std::vector<unsigned char> save() const;
+    bool load(std::vector<unsigned char> const &data);
+
+private:
+    unsigned int interval;
+    std::vector<unsigned char> starting_state;  ///< state at the start of the replay, to calculate the changes from
+    std::vector<Keyframe> keyframes;
+};
+
+std::string gd_replay_index_filename(CaveStored const &cave, CaveReplay const &replay);
+std::unique_ptr<ReplayIndex> gd_replay_index_load(CaveStored const &cave, CaveReplay const &replay);
+bool gd_replay_index_save(CaveStored const &cave, CaveReplay const &replay, ReplayIndex const &index);
+ReplayResult gd_replay_verify_segments(CaveStored const &cave, CaveReplay const &replay, ReplayIndex const &index, unsigned threads, int &failed_segments);
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <glib.h>
+#include <chrono>
+
+#include "cave/caveset.hpp"
+#include "cave/caverendered.hpp"
+#include "cave/helper/cavereplay.hpp"
+#include "cave/replayindex.hpp"
+#include "misc/parallel.hpp"
+#include "misc/printf.hpp"
+
+#include "cave/replayverify.hpp"
+
+
+/// Play a replay of a cave, like GameControl would do, but as fast as possible.
+/// The cave is iterated once for every movement stored. After the movements
+/// run out, the game lets the cave run for some more frames, before covering it;
+/// this is also done here, as the player might still exit then.
+/// The bonus points for the remaining time are added, if the player exited.
+/// @param cave The cave the replay was recorded in.
+/// @param replay The replay to play. Only a copy of it is rewound and played.
+/// @param full_scan Scan every cell of the cave in each iteration, as the game does,
+///     instead of skipping the idle ones. The result must be the same.
+ReplayResult gd_replay_play_headless(CaveStored const &cave, CaveReplay const &replay, bool full_scan) {
+    auto start = std::chrono::steady_clock::now();
+    CaveReplay playing(replay);
+    CaveRendered rendered(cave, playing.level - 1, playing.seed);
+    rendered.setup_for_game();
+    rendered.active_cell_scan = !full_scan;
+    playing.rewind();
+
+    ReplayResult result = gd_replay_play_headless_from(rendered, playing, ReplayResult());
+    result.wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+
+/// Play the rest of a replay from a given state, like gd_replay_play_headless().
+/// @param rendered The cave, in the state of the game after the movements of the replay already played.
+///     It is scanned as set up by the caller, see CaveRendered::active_cell_scan.
+/// @param playing The replay, at the position of the next movement to play.
+/// @param result The frames and score played until the current state; this is continued.
+/// @param frame_done If given, it is called after every iteration of the cave.
+/// @return The result of the whole replay. The wall time is not set.
+ReplayResult gd_replay_play_headless_from(CaveRendered &rendered, CaveReplay &playing, ReplayResult result,
+                                          std::function<void(CaveRendered const &)> const &frame_done) {
+    /* GameControl::main_int stops the replay after 16 iterations without movements */
+    int no_more_movements = 0;
+    GdDirectionEnum player_move = MV_STILL;
+    bool fire = false, suicide = false;
+    while (rendered.player_state != GD_PL_TIMEOUT && no_more_movements <= 15) {
+        if (!playing.get_next_movement(player_move, fire, suicide)) {
+            player_move = MV_STILL;
+            fire = suicide = false;
+            no_more_movements++;
+        }
+        rendered.iterate(player_move, fire, suicide);
+        result.frames++;
+        result.score += rendered.score;
+        /* nobody draws the particles, so do not let them pile up */
+        rendered.particles.clear();
+        if (frame_done)
+            frame_done(rendered);
+        if (rendered.player_state == GD_PL_EXITED)
+            break;
+        /* if the player died, pressing fire restarts the cave */
+        if (rendered.player_state == GD_PL_DIED && fire)
+            break;
+    }
+
+    result.success = rendered.player_state == GD_PL_EXITED;
+    if (result.success) {
+        /* same as GameControl::check_bonus_score_fast() */
+        while (rendered.time > 0) {
+            rendered.time -= rendered.timing_factor;
+            result.score += rendered.timevalue;
+        }
+    }
+    result.duration = rendered.time_elapsed / rendered.timing_factor;
+    return result;
+}
+
+
+/// Play all replays of all cavesets given, and print a report to the standard output.
+/// The replays are distributed among a pool of worker threads.
+/// A replay fails the verification, if it was recorded as successful but the
+/// player does not exit when playing it, or the other way around; or if the score
+/// differs from the recorded one. Replays which have a wrong checksum,
+/// ie. the cave was changed since recording, are played but not counted as failures.
+/// With segments, every replay is also played in segments from the keyframes of its
+/// index, with gd_replay_verify_segments(). The saved index of the replay is used, or
+/// one is built. The replay fails, if a segment does not arrive at the next keyframe,
+/// or the result differs from the one of playing the replay from the start.
+/// The segments always skip the idle cells, so with full_scan, this also checks
+/// that both ways of scanning the cave agree.
+/// @param cavesets The cavesets to check.
+/// @param threads The number of worker threads, 0 to use all processors.
+/// @param segments Also verify the replays in segments.
+/// @param full_scan Play the replays scanning every cell of the cave, as the game does.
+/// @return The number of failed replays.
+int gd_verify_replays(std::vector<CaveSet> const &cavesets, unsigned threads, bool segments, bool full_scan) {
+    struct Job {
+        CaveSet const *caveset;
+        CaveStored const *cave;
+        CaveReplay const *replay;
+        ReplayResult result;
+        bool segments_ok;
+        int segment_count;
+    };
+    std::vector<Job> jobs;
+    for (auto const &caveset : cavesets)
+        for (auto const &cave : caveset.caves)
+            for (auto const &replay : cave.replays)
+                jobs.push_back(Job{&caveset, &cave, &replay, ReplayResult(), true, 0});
+
+    auto start = std::chrono::steady_clock::now();
+    gd_parallel_for(jobs.size(), threads, [&jobs, segments, full_scan](unsigned i) {
+        Job &job = jobs[i];
+        job.result = gd_replay_play_headless(*job.cave, *job.replay, full_scan);
+        if (segments) {
+            std::unique_ptr<ReplayIndex> index = gd_replay_index_load(*job.cave, *job.replay);
+            if (!index)
+                index = ReplayIndex::build(*job.cave, *job.replay);
+            /* the replays are already distributed among the threads, so the segments are played on this one */
+            int failed_segments;
+            ReplayResult by_segments = gd_replay_verify_segments(*job.cave, *job.replay, *index, 1, failed_segments);
+            job.segment_count = index->get_keyframes().size() + 1;
+            job.segments_ok = failed_segments == 0
+                              && by_segments.success == job.result.success && by_segments.score == job.result.score
+                              && by_segments.frames == job.result.frames && by_segments.duration == job.result.duration;
+        }
+    });
+    double wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    /* print the report in the order of the replays, not in the order they finished */
+    int failed = 0, wrong_checksum = 0, segments_failed = 0, segment_count = 0;
+    double cpu_time = 0;
+    for (auto const &job : jobs) {
+        CaveReplay const &replay = *job.replay;
+        ReplayResult const &result = job.result;
+        char const *status;
+        if (replay.wrong_checksum) {
+            status = "CHECKSUM";
+            wrong_checksum++;
+        } else if (result.success != replay.success || result.score != replay.score) {
+            status = "FAIL";
+            failed++;
+        } else if (!job.segments_ok) {
+            status = "SEGMENTS";
+            failed++;
+        } else
+            status = "OK";
+        cpu_time += result.wall_time;
+        segment_count += job.segment_count;
+        if (!job.segments_ok)
+            segments_failed++;
+        g_print("%s", Printf("%-8s %s, %s, level %d, %s: success %s/%s, score %d/%d, %d frames, %d s cave time, %.1f ms\n",
+                             status, job.caveset->filename, job.cave->name, replay.level, replay.player_name,
+                             result.success ? "yes" : "no", replay.success ? "yes" : "no", result.score, replay.score,
+                             result.frames, result.duration, result.wall_time * 1000).c_str());
+    }
+    g_print("%s", Printf("%d replays: %d ok, %d failed, %d with wrong checksum; %.2f s cpu, %.2f s wall time\n",
+                         jobs.size(), jobs.size() - failed - wrong_checksum, failed, wrong_checksum,
+                         cpu_time, wall_time).c_str());
+    if (segments)
+        g_print("%s", Printf("%d segments played; %d replays differ when played in segments\n",
+                             segment_count, segments_failed).c_str());
+
+    return failed;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef REPLAYVERIFY_HPP_INCLUDED
+#define REPLAYVERIFY_HPP_INCLUDED
+
+#include "config.h"
+
+#include <functional>
+#include <vector>
+
+class CaveSet;
+class CaveStored;
+class CaveReplay;
+class CaveRendered;
+
+/// @ingroup Cave
+/// The outcome of playing a replay with the game engine only,
+/// without a screen, sounds or timers.
+struct ReplayResult {
+    bool success = false;       ///< true, if the player exited the cave
+    int score = 0;              ///< score collected, including the bonus points for the remaining time
+    int frames = 0;             ///< number of cave iterations played
+    int duration = 0;           ///< cave time elapsed, in seconds - as it would be stored in a replay
+    double wall_time = 0;       ///< real time spent on playing, in seconds
+};
+
+ReplayResult gd_replay_play_headless(CaveStored const &cave, CaveReplay const &replay, bool full_scan = false);
+ReplayResult gd_replay_play_headless_from(CaveRendered &rendered, CaveReplay &playing, ReplayResult result,
+                                          std::function<void(CaveRendered const &)> const &frame_done = nullptr);
+int gd_verify_replays(std::vector<CaveSet> const &cavesets, unsigned threads, bool segments = false, bool full_scan = false);
+
+#endif
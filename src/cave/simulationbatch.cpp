@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "cave/cavestored.hpp"
+#include "cave/caverendered.hpp"
+#include "misc/parallel.hpp"
+
+#include "cave/simulationbatch.hpp"
+
+
+/// A game being played by a worker thread.
+struct SimulationLane {
+    std::unique_ptr<CaveRendered> game;     ///< allocated for the first game, then reused
+    int job = -1;                           ///< index of the job played, -1 if the lane is free
+    int frames = 0;                         ///< frames played in this game
+};
+
+
+/// The cave states owned by a worker thread, which are kept between jobs.
+struct SimulationBatch::Worker {
+    std::unique_ptr<CaveRendered> start;    ///< the starting state rendered last
+    CaveStored const *start_cave = nullptr;
+    int start_level = 0, start_seed = 0;
+    std::vector<SimulationLane> lanes;
+    long long games = 0, frames = 0, renders = 0;
+
+    void begin(SimulationLane &lane, SimulationJob const &job, int index);
+    void step(SimulationLane &lane, SimulationJob const &job);
+    void play(std::vector<SimulationJob> const &jobs, std::vector<unsigned> const &chunks, std::atomic<unsigned> &next_chunk, unsigned lane_count);
+};
+
+
+/// Jobs are handed out to the workers in chunks of at most this many jobs,
+/// which all start from the same state. Fewer would mean more renders, more
+/// would balance the work worse among the threads.
+enum { SimulationChunkSize = 16 };
+
+
+/// Start a job in a lane. The starting state is only rendered, if the
+/// previous job of this worker started from a different one.
+void SimulationBatch::Worker::begin(SimulationLane &lane, SimulationJob const &job, int index) {
+    if (start == nullptr || start_cave != job.cave || start_level != job.level || start_seed != job.seed) {
+        start = std::make_unique<CaveRendered>(*job.cave, job.level, job.seed);
+        start->setup_for_game();
+        /* nothing is drawn, so the cave can be scanned with the faster scheduler */
+        start->active_cell_scan = true;
+        start_cave = job.cave;
+        start_level = job.level;
+        start_seed = job.seed;
+        renders += 1;
+    }
+    /* copying to an existing state reuses its maps */
+    if (lane.game == nullptr)
+        lane.game = std::make_unique<CaveRendered>(*start);
+    else
+        *lane.game = *start;
+    lane.job = index;
+    lane.frames = 0;
+}
+
+
+/// Play one frame of the game in a lane, or finish it if it is over.
+void SimulationBatch::Worker::step(SimulationLane &lane, SimulationJob const &job) {
+    CaveRendered &game = *lane.game;
+    bool over = lane.frames >= job.max_frames
+                || game.player_state == GD_PL_EXITED || game.player_state == GD_PL_TIMEOUT || game.player_state == GD_PL_DIED;
+    if (!over) {
+        GdDirectionEnum move = MV_STILL;
+        bool fire = false;
+        if (!job.input || job.input(game, move, fire)) {
+            game.iterate(move, fire, false);
+            /* nobody draws the particles, so do not let them pile up */
+            game.particles.clear();
+            lane.frames += 1;
+            frames += 1;
+        } else
+            over = true;
+    }
+    if (over) {
+        if (job.finished)
+            job.finished(game, lane.frames);
+        games += 1;
+        lane.job = -1;
+    }
+}
+
+
+/// Play jobs until there are no more left. The games in the lanes are
+/// iterated in turn, and a free lane takes the next job immediately.
+/// Jobs are taken from the chunks in order; chunk c is jobs chunks[c]..chunks[c+1]-1.
+void SimulationBatch::Worker::play(std::vector<SimulationJob> const &jobs, std::vector<unsigned> const &chunks, std::atomic<unsigned> &next_chunk, unsigned lane_count) {
+    if (lanes.size() < lane_count)
+        lanes.resize(lane_count);
+    unsigned index = 0, chunk_end = 0;
+    bool jobs_left = true;
+    for (;;) {
+        unsigned busy = 0;
+        for (unsigned l = 0; l < lane_count; ++l) {
+            SimulationLane &lane = lanes[l];
+            if (lane.job == -1 && jobs_left) {
+                if (index == chunk_end) {
+                    unsigned chunk = next_chunk++;
+                    if (chunk + 1 < chunks.size()) {
+                        index = chunks[chunk];
+                        chunk_end = chunks[chunk + 1];
+                    } else
+                        jobs_left = false;
+                }
+                if (index != chunk_end) {
+                    begin(lane, jobs[index], index);
+                    index += 1;
+                }
+            }
+            if (lane.job != -1) {
+                step(lane, jobs[lane.job]);
+                busy += 1;
+            }
+        }
+        if (busy == 0)
+            break;
+    }
+}
+
+
+/// @param threads The number of worker threads, 0 to use all processors.
+/// @param lanes The number of games each worker thread plays at the same time.
+SimulationBatch::SimulationBatch(unsigned threads, unsigned lanes)
+    : threads(threads), lanes(std::max(lanes, 1u)) {
+}
+
+
+SimulationBatch::~SimulationBatch() = default;
+
+
+/// Add a game to be played by the next run().
+void SimulationBatch::add(SimulationJob job) {
+    jobs.push_back(std::move(job));
+}
+
+
+/// Play all games added since the last run, and wait for them to finish.
+/// The finished functions of the jobs are called in no particular order.
+/// @return The number of games and frames played, and the time it took.
+SimulationStats SimulationBatch::run() {
+    auto start = std::chrono::steady_clock::now();
+    /* jobs which start from the same state come one after the other */
+    std::stable_sort(jobs.begin(), jobs.end(), [](SimulationJob const &a, SimulationJob const &b) {
+        if (a.cave != b.cave)
+            return std::less<CaveStored const *>()(a.cave, b.cave);
+        if (a.level != b.level)
+            return a.level < b.level;
+        return a.seed < b.seed;
+    });
+
+    /* and are handed out in chunks */
+    std::vector<unsigned> chunks;
+    for (unsigned i = 0; i < jobs.size(); ++i) {
+        bool same_start = i > 0 && jobs[i].cave == jobs[i - 1].cave && jobs[i].level == jobs[i - 1].level && jobs[i].seed == jobs[i - 1].seed;
+        if (!same_start || i - chunks.back() == SimulationChunkSize)
+            chunks.push_back(i);
+    }
+    chunks.push_back(jobs.size());
+
+    unsigned nthreads = threads != 0 ? threads : gd_parallel_default_threads();
+    nthreads = std::max(1u, std::min<unsigned>(nthreads, chunks.size() - 1));
+    while (workers.size() < nthreads)
+        workers.push_back(std::make_unique<Worker>());
+    for (auto &worker : workers)
+        worker->games = worker->frames = worker->renders = 0;
+
+    std::atomic<unsigned> next_chunk(0);
+    gd_parallel_for(nthreads, nthreads, [&](unsigned w) {
+        workers[w]->play(jobs, chunks, next_chunk, lanes);
+    });
+    jobs.clear();
+
+    SimulationStats stats;
+    for (auto &worker : workers) {
+        stats.games += worker->games;
+        stats.frames += worker->frames;
+        stats.renders += worker->renders;
+        /* the caves may not exist anymore at the next run */
+        worker->start_cave = nullptr;
+    }
+    stats.wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SIMULATIONBATCH_HPP_INCLUDED
+#define SIMULATIONBATCH_HPP_INCLUDED
+
+#include "config.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "cave/cavetypes.hpp"
+
+class CaveStored;
+class CaveRendered;
+
+/// @ingroup Cave
+/// A game to be played by a SimulationBatch.
+struct SimulationJob {
+    CaveStored const *cave = nullptr;   ///< the cave to play; must exist until SimulationBatch::run() returns
+    int level = 0;                      ///< level, 0 is level 1
+    int seed = 0;                       ///< the seed to render the cave with
+    int max_frames = 0;                 ///< stop playing after this number of frames
+    /// Gives the movement of the player for the next frame. Called with the cave before
+    /// each iteration; if it returns false, the game ends. Called on a worker thread,
+    /// but for one job never on two threads at the same time.
+    std::function<bool(CaveRendered const &cave, GdDirectionEnum &move, bool &fire)> input;
+    /// Called with the cave and the number of frames played, when the game is over. May be empty.
+    std::function<void(CaveRendered const &cave, int frames)> finished;
+};
+
+/// @ingroup Cave
+/// Counters of a SimulationBatch::run().
+struct SimulationStats {
+    long long games = 0;        ///< number of games played
+    long long frames = 0;       ///< number of frames iterated
+    long long renders = 0;      ///< number of starting maps rendered; the other games copied one
+    double wall_time = 0;       ///< real time spent, in seconds
+
+    double games_per_second() const {
+        return wall_time > 0 ? games / wall_time : 0;
+    }
+    double frames_per_second() const {
+        return wall_time > 0 ? frames / wall_time : 0;
+    }
+};
+
+/**
+ * @ingroup Cave
+ * Plays many independent games without drawing anything, as fast as possible.
+ *
+ * Constructing a CaveRendered is slow: the objects of the cave are drawn, and
+ * the maps allocated. So the jobs are ordered by cave, level and seed, and the
+ * starting state is rendered only once for the jobs which share it; each game
+ * then starts from a copy of it. The copies go to cave states kept by the
+ * worker threads, which are allocated once and reused for all later jobs,
+ * also in later runs of the same batch. Each worker thread plays some games at
+ * the same time, one frame of each in turn.
+ *
+ * The games are the same as if they were played one by one, with a new
+ * CaveRendered each, with active_cell_scan set and the particles cleared
+ * after every frame.
+ */
+class SimulationBatch {
+    struct Worker;
+
+    unsigned threads;
+    unsigned lanes;
+    std::vector<SimulationJob> jobs;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+public:
+    explicit SimulationBatch(unsigned threads = 0, unsigned lanes = 4);
+    ~SimulationBatch();
+    SimulationBatch(SimulationBatch const &) = delete;
+    SimulationBatch &operator=(SimulationBatch const &) = delete;
+
+    void add(SimulationJob job);
+    /// Number of jobs waiting for run().
+    size_t size() const {
+        return jobs.size();
+    }
+    SimulationStats run();
+};
+
+#endif
@@ -29,6 +29,8 @@
 #include <set>
 #include <algorithm>
 #include <memory>
+#include <atomic>
+#include <thread>
 #include <glib/gi18n.h>
 
 #include "cave/caverendered.hpp"
@@ -51,6 +53,7 @@
 #include "gtk/gtkpixbuf.hpp"
 #include "framework/commands.hpp"
 #include "cave/gamecontrol.hpp"
+#include "cave/cavedifficulty.hpp"
 #include "cave/titleanimation.hpp"
 #include "misc/helptext.hpp"
 #include "mainwindow.hpp"
@@ -671,7 +674,145 @@ static bool edit_properties(const char *title, Reflective *str, Reflective *def_
 }
 
 
-/* call edit_properties for a cave, then do some cleanup.
+/* the difficulty page of the cave properties dialog.
+ * plays the cave being edited with simulated players, and shows how they fared.
+ * the playthroughs run on another thread, so the dialog stays responsive;
+ * a timeout polls the progress, and shows the results when the thread finished. */
+struct CaveDifficultyPage {
+    CaveStored const *cave;
+    GtkWidget *button;
+    GtkWidget *grid;
+    GtkWidget *progress;
+
+    std::unique_ptr<CaveStored const> analysed;     /* copy of the cave, as the user may still edit the properties meanwhile */
+    std::vector<DifficultyLevel> levels;
+    std::atomic<int> done;
+    std::atomic<bool> cancel, finished;
+    std::thread worker;
+    guint timeout_id;
+
+    explicit CaveDifficultyPage(CaveStored const *cave)
+        : cave(cave), button(NULL), grid(NULL), progress(NULL), done(0), cancel(false), finished(false), timeout_id(0) {}
+};
+
+/* number of playthroughs on each level */
+static int const difficulty_page_runs = 200;
+
+
+/* show the results of the analysis in the grid of the page. */
+static void cave_difficulty_show_results(CaveDifficultyPage *page) {
+    GtkGrid *grid = GTK_GRID(page->grid);
+    gtk_grid_attach(grid, gd_label_new_leftaligned(_("<b>Exited</b>")), 0, 1, 1, 1);
+    gtk_grid_attach(grid, gd_label_new_leftaligned(_("<b>Out of time</b>")), 0, 2, 1, 1);
+    gtk_grid_attach(grid, gd_label_new_leftaligned(_("<b>Died</b>")), 0, 3, 1, 1);
+    gtk_grid_attach(grid, gd_label_new_leftaligned(_("<b>Survived (median)</b>")), 0, 4, 1, 1);
+    gtk_grid_attach(grid, gd_label_new_leftaligned(_("<b>Diamonds (median)</b>")), 0, 5, 1, 1);
+    gtk_grid_attach(grid, gd_label_new_leftaligned(_("<b>Time left (median)</b>")), 0, 6, 1, 1);
+    for (unsigned i = 0; i < page->levels.size(); ++i) {
+        DifficultyLevel const &level = page->levels[i];
+        int col = i + 1;
+        int diamonds_needed = level.runs.empty() ? 0 : level.runs[0].diamonds_needed;
+        gtk_grid_attach(grid, gd_label_new_rightaligned(Printf(_("<b>Level %d</b>"), level.level + 1).c_str()), col, 0, 1, 1);
+        gtk_grid_attach(grid, gd_label_new_rightaligned(Printf("%4.1f%%", level.percent(GD_OUTCOME_EXITED)).c_str()), col, 1, 1, 1);
+        gtk_grid_attach(grid, gd_label_new_rightaligned(Printf("%4.1f%%", level.percent(GD_OUTCOME_TIMEOUT)).c_str()), col, 2, 1, 1);
+        gtk_grid_attach(grid, gd_label_new_rightaligned(Printf("%4.1f%%", level.percent_died()).c_str()), col, 3, 1, 1);
+        gtk_grid_attach(grid, gd_label_new_rightaligned(Printf(_("%d s"), int(level.seconds_percentile(0.5))).c_str()), col, 4, 1, 1);
+        gtk_grid_attach(grid, gd_label_new_rightaligned(Printf(_("%d of %d"), int(level.diamonds_percentile(0.5)), diamonds_needed).c_str()), col, 5, 1, 1);
+        if (level.percent(GD_OUTCOME_EXITED) > 0)
+            gtk_grid_attach(grid, gd_label_new_rightaligned(Printf(_("%d s"), int(level.time_left_percentile(0.5))).c_str()), col, 6, 1, 1);
+        else
+            gtk_grid_attach(grid, gd_label_new_rightaligned("-"), col, 6, 1, 1);
+    }
+    gtk_widget_show_all(page->grid);
+}
+
+
+/* called periodically while the analysis runs; updates the progress bar,
+ * and when the worker thread finished, shows the results. */
+static gboolean cave_difficulty_timeout(gpointer data) {
+    CaveDifficultyPage *page = static_cast<CaveDifficultyPage *>(data);
+    int const total = difficulty_page_runs * (page->analysed->has_levels() ? 5 : 1);
+
+    if (!page->finished) {
+        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(page->progress), double(page->done) / total);
+        return TRUE;
+    }
+
+    page->worker.join();
+    page->timeout_id = 0;
+    gtk_widget_hide(page->progress);
+    cave_difficulty_show_results(page);
+    page->levels.clear();
+    page->analysed.reset();
+    gtk_widget_set_sensitive(page->button, TRUE);
+    return FALSE;   /* remove the timeout */
+}
+
+
+static void cave_difficulty_analyse_cb(GtkWidget *button, gpointer data) {
+    CaveDifficultyPage *page = static_cast<CaveDifficultyPage *>(data);
+    if (page->worker.joinable())
+        return;
+
+    /* remove the results of the previous analysis, and show that we are working */
+    GList *children = gtk_container_get_children(GTK_CONTAINER(page->grid));
+    for (GList *iter = children; iter != NULL; iter = iter->next)
+        gtk_widget_destroy(GTK_WIDGET(iter->data));
+    g_list_free(children);
+    gtk_widget_set_sensitive(button, FALSE);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(page->progress), 0);
+    gtk_widget_show(page->progress);
+
+    page->analysed = std::make_unique<CaveStored const>(*page->cave);
+    page->done = 0;
+    page->cancel = false;
+    page->finished = false;
+    page->worker = std::thread([page]() {
+        page->levels = gd_difficulty_analyse(*page->analysed, difficulty_page_runs, GD_PLAY_GREEDY, 0, &page->done, &page->cancel);
+        page->finished = true;
+    });
+    page->timeout_id = g_timeout_add(40, cave_difficulty_timeout, page);
+}
+
+
+/* stop the analysis, if it is still running. must be called before the dialog is destroyed. */
+static void cave_difficulty_stop(CaveDifficultyPage &page) {
+    if (page.timeout_id != 0) {
+        g_source_remove(page.timeout_id);
+        page.timeout_id = 0;
+    }
+    if (page.worker.joinable()) {
+        page.cancel = true;
+        page.worker.join();
+    }
+}
+
+
+/* add the difficulty page to the notebook of the cave properties dialog. */
+static void cave_difficulty_add_page(GtkWidget *notebook, CaveDifficultyPage &page) {
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 12);
+    gtk_container_set_border_width(GTK_CONTAINER(box), 12);
+    GtkWidget *label = gd_label_new_leftaligned(_("Play the cave 200 times on each level with simulated players, "
+                                                  "who walk towards the nearest diamond or the exit, and sometimes move randomly. "
+                                                  "The cave is played with the properties set in this dialog."));
+    gtk_label_set_line_wrap(GTK_LABEL(label), TRUE);
+    gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
+    page.button = gtk_button_new_with_mnemonic(_("_Analyse"));
+    gtk_widget_set_halign(page.button, GTK_ALIGN_START);
+    gtk_box_pack_start(GTK_BOX(box), page.button, FALSE, FALSE, 0);
+    page.progress = gtk_progress_bar_new();
+    gtk_widget_set_no_show_all(page.progress, TRUE);
+    gtk_box_pack_start(GTK_BOX(box), page.progress, FALSE, FALSE, 0);
+    page.grid = gtk_grid_new();
+    gtk_grid_set_row_spacing(GTK_GRID(page.grid), 6);
+    gtk_grid_set_column_spacing(GTK_GRID(page.grid), 12);
+    gtk_box_pack_start(GTK_BOX(box), page.grid, FALSE, FALSE, 0);
+    g_signal_connect(page.button, "clicked", G_CALLBACK(cave_difficulty_analyse_cb), &page);
+    gtk_notebook_append_page(GTK_NOTEBOOK(notebook), box, gtk_label_new(_("Difficulty")));
+}
+
+
+/* edit the properties of a cave, and show its difficulty; then do some cleanup.
  * for example, if the size changed, the map has to be resized,
  * etc. also the user may be warned about resizing the visible area. */
 static void cave_properties(CaveStored &cave, gboolean show_cancel) {
@@ -682,7 +823,15 @@ static void cave_properties(CaveStored &cave, gboolean show_cancel) {
     // Then later decide what to do.
     CaveStored copy = cave;
     CaveStored def_cave;
-    bool edited = edit_properties(_("Cave Properties"), &copy, &def_cave, show_cancel, NULL);
+    GtkWidget *dialog, *notebook;
+    edit_properties_create_window(_("Cave Properties"), show_cancel, dialog, notebook);
+    std::vector<std::unique_ptr<EditorAutoUpdate>> eau_s = edit_properties_add_widgets(notebook, copy.get_description_array(), &copy, &def_cave, NULL);
+    CaveDifficultyPage difficulty_page(&copy);
+    cave_difficulty_add_page(notebook, difficulty_page);
+    gtk_widget_show_all(dialog);
+    bool edited = gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT;
+    cave_difficulty_stop(difficulty_page);
+    gtk_widget_destroy(dialog);
 
     if (!edited)
         return;
@@ -2622,7 +2771,7 @@ flatten_cave_cb(GtkWidget *widget, gpointer data) {
         undo_save();    /* changing; save for undo */
 
         CaveRendered rendered(edited_cave(), edit_level, 0);   /* render cave at specified level to obtain map. seed=0 */
-        edited_cave().map = rendered.map;    /* copy new map to cave */
+        edited_cave().map = rendered.map.to_cave_map();    /* copy new map to cave */
         edited_cave().objects.clear();       /* forget objects */
         render_cave();      /* redraw */
     }
@@ -23,6 +23,9 @@
 
 #include "config.h"
 
+#include <glib.h>
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <stdexcept>
 #include "fileops/bdcffhelper.hpp"
@@ -40,6 +43,72 @@ AttribParam::AttribParam(const std::string &str, char separator) {
 }
 
 
+/// Constructor: split a line given by the separator given to attrib and param.
+/// @param line The line to split.
+/// @param separator Separator between attrib and param; default is =.
+AttribParam::AttribParam(BdcffLine const &line, char separator) {
+    size_t equal = line.find(separator);
+    if (equal == BdcffLine::npos)
+        throw std::runtime_error(Printf("No separator in line: '%s'", line.str()));
+    attrib.assign(line.data(), equal);
+    param.assign(line.data() + equal + 1, line.size() - equal - 1);
+}
+
+
+/// Find a character in the line.
+/// @return The position of the character, or npos if not found.
+size_t BdcffLine::find(char c) const {
+    void const *found = memchr(text, c, length);
+    return found != NULL ? (char const *) found - text : npos;
+}
+
+
+/// Part of the line from pos, at most n characters long.
+BdcffLine BdcffLine::substr(size_t pos, size_t n) const {
+    pos = std::min(pos, length);
+    return BdcffLine(text + pos, std::min(n, length - pos));
+}
+
+
+/// Remove spaces from the beginning and the end of the line, as gd_strchomp() does.
+void BdcffLine::strip_spaces() {
+    while (length > 0 && text[0] == ' ') {
+        text++;
+        length--;
+    }
+    while (length > 0 && text[length - 1] == ' ')
+        length--;
+}
+
+
+/// Check if the line is the same as the string, ignoring the case of ascii characters.
+bool BdcffLine::caseequal(char const *s) const {
+    return strlen(s) == length && g_ascii_strncasecmp(text, s, length) == 0;
+}
+
+
+/// Check if the line starts with the prefix, ignoring the case of ascii characters.
+bool BdcffLine::caseprefix(std::string const &prefix) const {
+    return prefix.length() <= length && g_ascii_strncasecmp(text, prefix.c_str(), prefix.length()) == 0;
+}
+
+
+/// Split the string to words at the spaces.
+BdcffWords::BdcffWords(std::string const &str)
+    :   buffer(str) {
+    /* for an empty string, there are no words, as for g_strsplit_set */
+    if (!buffer.empty()) {
+        words.push_back(&buffer[0]);
+        for (size_t i = 0; i < buffer.size(); ++i)
+            if (buffer[i] == ' ') {
+                buffer[i] = '\0';
+                words.push_back(&buffer[i + 1]);
+            }
+    }
+    words.push_back(NULL);
+}
+
+
 /// Create a new formatter.
 /// @param F The name of the output string; for example
 ///         give it "Point" if intending to write a line like "Point=1 2 DIRT"
@@ -29,10 +29,53 @@
 #include <string>
 #include <list>
 #include <sstream>
+#include <vector>
 #include "misc/util.hpp"
 
 #define BDCFF_VERSION "0.5"
 
+/**
+ * A line of a BDCFF file, or a part of it, in the text of the file.
+ *
+ * The loader splits the file into lines and sections with these, so the text
+ * is never copied while parsing; std::strings are only created of the
+ * attributes and parameters when they are stored. The text must outlive
+ * the object.
+ */
+class BdcffLine {
+    char const *text = nullptr;
+    size_t length = 0;
+
+public:
+    static size_t const npos = std::string::npos;
+
+    BdcffLine() = default;
+    BdcffLine(char const *text, size_t length) : text(text), length(length) {
+    }
+    char const *data() const {
+        return text;
+    }
+    size_t size() const {
+        return length;
+    }
+    bool empty() const {
+        return length == 0;
+    }
+    char operator[](size_t i) const {
+        return text[i];
+    }
+    /// Copy to a string.
+    std::string str() const {
+        return std::string(text, length);
+    }
+    size_t find(char c) const;
+    BdcffLine substr(size_t pos, size_t n = npos) const;
+    void strip_spaces();
+    bool caseequal(char const *s) const;
+    bool caseprefix(std::string const &prefix) const;
+};
+
+
 /**
  *  Functor which checks if a string has another string as its prefix.
  *  eg, it will return true for "SlimePermeability=0.1" begins with "SlimePermeability"
@@ -49,6 +92,10 @@ public:
     bool operator()(const std::string &str) const {
         return gd_str_ascii_prefix(str, attrib);
     }
+    /// Check if the given line has the prefix.
+    bool operator()(BdcffLine const &line) const {
+        return line.caseprefix(attrib);
+    }
 };
 
 
@@ -61,6 +108,32 @@ public:
     std::string attrib;
     std::string param;
     explicit AttribParam(const std::string &str, char separator = '=');
+    explicit AttribParam(BdcffLine const &line, char separator = '=');
+};
+
+
+/// Splits the parameters of a BDCFF line at the spaces, like g_strsplit_set(str, " ", -1)
+/// does: two spaces next to each other give an empty word. The words are stored in
+/// a single copy of the string, and the one after the last word is NULL.
+/// The words point into the buffer, so the object cannot be copied or moved.
+class BdcffWords {
+    std::string buffer;
+    std::vector<char const *> words;
+
+public:
+    explicit BdcffWords(std::string const &str);
+    BdcffWords(BdcffWords const &) = delete;
+    BdcffWords(BdcffWords &&) = delete;
+    BdcffWords &operator=(BdcffWords const &) = delete;
+    BdcffWords &operator=(BdcffWords &&) = delete;
+    /// Number of words.
+    int size() const {
+        return int(words.size()) - 1;
+    }
+    /// The i-th word; NULL for i == size().
+    char const *operator[](int i) const {
+        return words[i];
+    }
 };
 
 /**
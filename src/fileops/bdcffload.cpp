@@ -24,6 +24,8 @@
 #include "config.h"
 
 #include <glib.h>
+#include <algorithm>
+#include <cstring>
 
 #include "fileops/bdcffload.hpp"
 
@@ -44,19 +46,45 @@
 #include "cave/object/caveobjectfillrect.hpp" /* bdcff intermission hack - adding a cavefillrect */
 
 
+/**
+ * The lines of a BDCFF file sorted into sections, like BdcffFile, but the lines
+ * are parts of the text of the file loaded, so they are not copied.
+ */
+struct BdcffFileLines {
+    typedef std::vector<BdcffLine> Section;
+    struct CaveInfo {
+        Section highscore;
+        Section properties;
+        Section map;
+        Section objects;
+        std::vector<Section> replays;
+        std::vector<std::string> demo;
+    };
+
+    Section bdcff;
+    Section highscore;
+    Section mapcodes;
+    Section caveset_properties;
+    std::vector<CaveInfo> caves;
+    /// Lines which had to be changed, as they had \r characters inside. Lines of the
+    /// sections may point to these, too.
+    std::list<std::string> cleaned_lines;
+};
+
+
 /// @todo remove
 bool struct_set_property(Reflective &str, const std::string &attrib, const std::string &param, int ratio, PropertyDescription const *prop_desc) {
     int paramindex = 0;
 
-    char **params = g_strsplit_set(param.c_str(), " ", -1);
-    int paramcount = g_strv_length(params);
+    BdcffWords params(param);
+    int paramcount = params.size();
     bool identifier_found = false;
 
     /* check all known tags. do not exit this loop if identifier_found==true...
        as there are more lines in the array which have the same identifier. */
     bool was_string = false;
     for (unsigned i = 0; prop_desc[i].identifier != NULL; i++)
-        if (gd_str_ascii_caseequal(prop_desc[i].identifier, attrib)) {
+        if (g_ascii_strcasecmp(prop_desc[i].identifier, attrib.c_str()) == 0) {
             /* found the identifier */
             identifier_found = true;
             std::unique_ptr<GetterBase> const &prop = prop_desc[i].prop;
@@ -141,7 +169,6 @@ bool struct_set_property(Reflective &str, const std::string &attrib, const std::
     /* of course, not for strings, as the whole line is the string */
     if (identifier_found && !was_string && paramindex < paramcount)
         gd_message("excess parameters for attribute '%s': '%s'", attrib, params[paramindex]);
-    g_strfreev(params);
 
     return identifier_found;
 }
@@ -171,15 +198,6 @@ static bool replay_process_tag(CaveReplay &replay, const std::string &attrib, co
 
 
 static bool cave_process_tags_func(CaveStored &cave, const std::string &attrib, const std::string &param) {
-    char **params = g_strsplit_set(param.c_str(), " ", -1);
-    /// @todo make an autoptr-like class for this stuff
-    struct Finally {
-        char **params;
-        Finally(char **params) : params(params) {}
-        ~Finally() { g_strfreev(params); }
-    } finally(params);
-    int paramcount = g_strv_length(params);
-
     /* compatibility with old snapexplosions flag */
     if (gd_str_ascii_caseequal(attrib, "SnapExplosions")) {
         GdBool b;
@@ -217,6 +235,7 @@ static bool cave_process_tags_func(CaveStored &cave, const std::string &attrib,
     
     /* compatibility with old AmoebaProperties flag */
     if (gd_str_ascii_caseequal(attrib, "AmoebaProperties")) {
+        BdcffWords params(param);
         GdElement elem1 = O_STONE, elem2 = O_DIAMOND;
         bool success = read_from_string(params[0], elem1) && read_from_string(params[1], elem2);
         if (success) {
@@ -230,6 +249,8 @@ static bool cave_process_tags_func(CaveStored &cave, const std::string &attrib,
     /* colors attribute is a mess, have to process explicitly */
     if (gd_str_ascii_caseequal(attrib, "Colors")) {
         /* Colors=[border background] foreground1 foreground2 foreground3 [amoeba slime] */
+        BdcffWords params(param);
+        int paramcount = params.size();
         bool ok = true;
         GdColor cb, c0, c1, c2, c3, c4, c5;
 
@@ -282,7 +303,8 @@ static bool cave_process_tags_func(CaveStored &cave, const std::string &attrib,
     /* effects are also handled in an ugly way in bdcff */
     if (gd_str_ascii_caseequal(attrib, "Effect")) {
         /* an effect command has two parameters */
-        if (paramcount == 2) {
+        BdcffWords params(param);
+        if (params.size() == 2) {
             bool success = false;
             PropertyDescription const *descriptor = cave.get_description_array();
 
@@ -344,7 +366,7 @@ static bool cave_process_tags_func(CaveStored &cave, const std::string &attrib,
 /// @param lines The list of lines to find the attrib in.
 /// @param name The name of the attribute to find.
 /// @return true, if the property is found. If found, it is also processed and removed.
-static bool cave_process_specific_tag(CaveStored &cave, BdcffFile::BdcffSection &lines, const std::string &name) {
+static bool cave_process_specific_tag(CaveStored &cave, BdcffFileLines::Section &lines, const std::string &name) {
     auto it = find_if(lines.begin(), lines.end(), HasAttrib(name));
     bool found = it != lines.end();
     if (found) {
@@ -352,7 +374,7 @@ static bool cave_process_specific_tag(CaveStored &cave, BdcffFile::BdcffSection
             AttribParam ap(*it);        // split into attrib and param
             cave_process_tags_func(cave, ap.attrib, ap.param);
         } catch (std::exception &e) {
-            gd_warning("Cannot parse: %s", *it);
+            gd_warning("Cannot parse: %s", it->str());
         }
         lines.erase(it);            // erase after processing
     }
@@ -364,7 +386,7 @@ static bool cave_process_specific_tag(CaveStored &cave, BdcffFile::BdcffSection
 /// For example, the name is processed first, to be able to show all error messages with the cave name context.
 /// Then the engine tag is processed - well, because bdcff sucks.
 /// Then the size - to make sure ratios are read correctly - bdcff sucks.
-static void cave_process_all_tags(CaveStored &cave, BdcffFile::BdcffSection &lines) {
+static void cave_process_all_tags(CaveStored &cave, BdcffFileLines::Section &lines) {
     // first check cave name, so we can report errors correctly (saying that CaveStored xy: error foobar)
     cave_process_specific_tag(cave, lines, "Name");
     SetLoggerContextForFunction scf((cave.name == "") ? Printf("<unnamed cave>") : (Printf("Cave '%s'", cave.name)));
@@ -403,11 +425,11 @@ static void cave_process_all_tags(CaveStored &cave, BdcffFile::BdcffSection &lin
             AttribParam ap(*it);
             if (!cave_process_tags_func(cave, ap.attrib, ap.param)) {
                 gd_message("unknown tag '%s'", ap.attrib);
-                cave.unknown_tags += *it;
+                cave.unknown_tags.append(it->data(), it->size());
                 cave.unknown_tags += '\n';
             }
         } catch (std::exception &e) {
-            gd_warning("Cannot parse line: %s", *it);
+            gd_warning("Cannot parse line: %s", it->str());
         }
     }
 }
@@ -426,9 +448,10 @@ static bool add_highscore(HighScoreTable &hs, const std::string &name, const std
     return true;
 }
 
-static BdcffFile parse_bdcff_sections(const char *file_contents) {
-    BdcffFile file;
-    std::istringstream is(file_contents);
+/// Split the file into lines, and sort them into the sections of the file.
+/// The lines point into the text, which must be kept until they are processed.
+static BdcffFileLines parse_bdcff_sections(const char *file_contents) {
+    BdcffFileLines file;
     enum ReadState {
         Start,          ///< should be nothing here.
         Bdcff,          ///< inside [bdcff], eg. version=0.5
@@ -444,39 +467,52 @@ static BdcffFile parse_bdcff_sections(const char *file_contents) {
         CaveMap         ///< map-encoded cave
     } state;
 
-    std::string line;
     state = Start;
     bool bailout = false;
-    for (int lineno = 1; !bailout && getline(is, line); lineno++) {
-        SetLoggerContextForFunction scf(Printf("Line %d", lineno));
-
-        size_t found_r;
-        while ((found_r = line.find('\r')) != std::string::npos)
-            line.erase(found_r, 1);     /* remove windows-nightmare \r-s */
+    char const *next = file_contents;
+    for (int lineno = 1; !bailout && *next != '\0'; lineno++) {
+        char const *end = strchr(next, '\n');
+        if (end == NULL)
+            end = next + strlen(next);
+        BdcffLine line(next, end - next);
+        next = *end == '\n' ? end + 1 : end;
+
+        /* remove windows-nightmare \r-s. they are usually at the end, so the line can be shortened;
+         * if there is one inside, the line must be copied */
+        while (!line.empty() && line[line.size() - 1] == '\r')
+            line = line.substr(0, line.size() - 1);
+        if (line.find('\r') != BdcffLine::npos) {
+            std::string cleaned = line.str();
+            cleaned.erase(std::remove(cleaned.begin(), cleaned.end(), '\r'), cleaned.end());
+            file.cleaned_lines.push_back(cleaned);
+            line = BdcffLine(file.cleaned_lines.back().data(), file.cleaned_lines.back().size());
+        }
         if (line.empty())
             continue;                   /* skip empty lines */
 
+        SetLoggerContextForFunction scf(Printf("Line %d", lineno));
+
         if (state != CaveMap && line[0] == ';')
             continue;                   /* just skip comments. be aware that map lines may start with a semicolon... */
 
         /* STARTING WITH A BRACKET [ IS A SECTION */
         if (line[0] == '[') {
-            if (gd_str_ascii_caseequal(line, "[BDCFF]")) {
+            if (line.caseequal("[BDCFF]")) {
                 if (state != Start) {
                     gd_critical("first section should be [BDCFF]. Bailing out!");
                     bailout = true;
                 }
                 state = Bdcff;
-            } else if (gd_str_ascii_caseequal(line, "[/BDCFF]")) {
+            } else if (line.caseequal("[/BDCFF]")) {
                 state = Start;
-            } else if (gd_str_ascii_caseequal(line, "[game]")) {
+            } else if (line.caseequal("[game]")) {
                 if (state != Bdcff)
                     gd_warning("[game] should be inside [BDCFF]");
                 state = Game;
-            } else if (gd_str_ascii_caseequal(line, "[/game]")) {
+            } else if (line.caseequal("[/game]")) {
                 if (state != Game)
                     gd_warning("[/game] not in [game] section");
-            } else if (gd_str_ascii_caseequal(line, "[mapcodes]")) {
+            } else if (line.caseequal("[mapcodes]")) {
                 switch (state) {
                     case Game:
                         state = GameMapCodes;
@@ -489,7 +525,7 @@ static BdcffFile parse_bdcff_sections(const char *file_contents) {
                         state = BdcffMapCodes;
                         break;
                 }
-            } else if (gd_str_ascii_caseequal(line, "[/mapcodes]")) {
+            } else if (line.caseequal("[/mapcodes]")) {
                 switch (state) {
                     case GameMapCodes:
                         state = Game;
@@ -501,25 +537,25 @@ static BdcffFile parse_bdcff_sections(const char *file_contents) {
                         gd_warning("[/mapcodes] not after [mapcodes]");
                         state = Game;
                 }
-            } else if (gd_str_ascii_caseequal(line, "[cave]")) {
+            } else if (line.caseequal("[cave]")) {
                 if (state != Game)
                     gd_warning("[cave] allowed only in [game] section");
                 state = Cave;
-                file.caves.push_back(BdcffFile::CaveInfo());    /* new empty space for a cave */
-            } else if (gd_str_ascii_caseequal(line, "[/cave]")) {
+                file.caves.push_back(BdcffFileLines::CaveInfo());    /* new empty space for a cave */
+            } else if (line.caseequal("[/cave]")) {
                 if (state != Cave)
                     gd_warning("[/cave] tag without starting [cave]");
                 state = Game;
-            } else if (gd_str_ascii_caseequal(line, "[map]")) {
+            } else if (line.caseequal("[map]")) {
                 if (state != Cave)
                     gd_warning("[map] section only allowed inside [cave]");
                 else    /* else: do not enter map reading when not in a cave! */
                     state = CaveMap;
-            } else if (gd_str_ascii_caseequal(line, "[/map]")) {
+            } else if (line.caseequal("[/map]")) {
                 if (state != CaveMap)
                     gd_warning("[/map] tag without starting [map]");
                 state = Cave;
-            } else if (gd_str_ascii_caseequal(line, "[highscore]")) {
+            } else if (line.caseequal("[highscore]")) {
                 /* can be inside game or cave */
                 if (state == Game)
                     state = GameHighScore;
@@ -529,7 +565,7 @@ static BdcffFile parse_bdcff_sections(const char *file_contents) {
                     gd_critical("[highscore] section only allowed inside [game] and [cave]. This confuses the parser, bailing out!");
                     bailout = true;
                 }
-            } else if (gd_str_ascii_caseequal(line, "[/highscore]")) {
+            } else if (line.caseequal("[/highscore]")) {
                 if (state == GameHighScore)
                     state = Game;
                 else if (state == CaveHighScore)
@@ -538,60 +574,60 @@ static BdcffFile parse_bdcff_sections(const char *file_contents) {
                     gd_critical("[/highscore] only allowed after starting [highscore]. This confuses the parser, bailing out!");
                     bailout = true;
                 }
-            } else if (gd_str_ascii_caseequal(line, "[objects]")) {
+            } else if (line.caseequal("[objects]")) {
                 if (state != Cave)
                     gd_warning("[objects] tag only allowed in [cave]");
                 if (file.caves.empty()) {
                     gd_warning("[replay] tag does not belong to any cave!");
-                    file.caves.push_back(BdcffFile::CaveInfo());
+                    file.caves.push_back(BdcffFileLines::CaveInfo());
                 }
                 state = CaveObjects;
-            } else if (gd_str_ascii_caseequal(line, "[/objects]")) {
+            } else if (line.caseequal("[/objects]")) {
                 if (state != CaveObjects)
                     gd_warning("[/objects] tag without starting [objects] tag");
                 state = Cave;
-            } else if (gd_str_ascii_caseequal(line, "[demo]")) {
+            } else if (line.caseequal("[demo]")) {
                 if (state != Cave)
                     gd_warning("[demo] tag only allowed in [cave]");
                 if (file.caves.empty()) {
                     gd_warning("[demo] tag does not belong to any cave!");
-                    file.caves.push_back(BdcffFile::CaveInfo());
+                    file.caves.push_back(BdcffFileLines::CaveInfo());
                 }
                 state = CaveDemo;
                 file.caves.back().demo.push_back("");   /* push an empty string, lines will be added */
-            } else if (gd_str_ascii_caseequal(line, "[/demo]")) {
+            } else if (line.caseequal("[/demo]")) {
                 if (state != CaveDemo)
                     gd_warning("[/demo] tag without starting [demo] tag");
                 state = Cave;
-            } else if (gd_str_ascii_caseequal(line, "[replay]")) {
+            } else if (line.caseequal("[replay]")) {
                 if (state != Cave)
                     gd_warning("[replay] tag only allowed in [cave]");
                 if (file.caves.empty()) {
                     gd_warning("[replay] tag does not belong to any cave!");
-                    file.caves.push_back(BdcffFile::CaveInfo());
+                    file.caves.push_back(BdcffFileLines::CaveInfo());
                 }
                 state = CaveSReplay;
-                file.caves.back().replays.push_back(BdcffFile::BdcffSection());
-            } else if (gd_str_ascii_caseequal(line, "[/replay]")) {
+                file.caves.back().replays.push_back(BdcffFileLines::Section());
+            } else if (line.caseequal("[/replay]")) {
                 if (state != CaveSReplay)
                     gd_warning("[/replay] tag without starting [replay] tag");
                 state = Cave;
             }
             /* GOSH i hate bdcff */
-            else if (gd_str_ascii_prefix(line, "[level=")) {
+            else if (line.caseprefix("[level=")) {
                 /* dump this thing in the object list. */
                 if (state != CaveObjects)
                     gd_message("[level] tag only allowed inside [objects] section. Ignored.");
                 else
                     file.caves.back().objects.push_back(line);
-            } else if (gd_str_ascii_caseequal(line, "[/level]")) {
+            } else if (line.caseequal("[/level]")) {
                 /* dump this thing in the object list. */
                 if (state != CaveObjects)
                     gd_message("[/level] tag only allowed inside [objects] section. Ignored.");
                 else
                     file.caves.back().objects.push_back(line);
             } else
-                gd_warning("unknown section: \"%s\"", line);
+                gd_warning("unknown section: \"%s\"", line.str());
 
             continue;
         }
@@ -606,11 +642,11 @@ static BdcffFile parse_bdcff_sections(const char *file_contents) {
         }
 
         /* if not a map, we may strip spaces. do it here. */
-        gd_strchomp(line);
+        line.strip_spaces();
 
         switch (state) {
             case Start: /* should be nothing here. */
-                gd_critical("nothing allowed outside [BDCFF]: %s", line);
+                gd_critical("nothing allowed outside [BDCFF]: %s", line.str());
                 bailout = true;
                 break;
 
@@ -641,7 +677,7 @@ static BdcffFile parse_bdcff_sections(const char *file_contents) {
 
             case CaveDemo:      /* old styled demo (replay), just movements, no random data & the like */
                 /* does not contain anything to check for! */
-                file.caves.back().demo.back() += line + ' ';
+                file.caves.back().demo.back().append(line.data(), line.size()) += ' ';
                 break;
 
             case CaveHighScore: /* highscores for a cave */
@@ -667,7 +703,7 @@ static BdcffFile parse_bdcff_sections(const char *file_contents) {
 
 CaveSet load_from_bdcff(const char *contents) {
     // this may throw, but we do not catch
-    BdcffFile file = parse_bdcff_sections(contents);
+    BdcffFileLines file = parse_bdcff_sections(contents);
 
     /* this cave will store the default properties, specified in the [game] section for caves. */
     /* especially the pain-in-the-ass engine tag. */
@@ -735,9 +771,9 @@ CaveSet load_from_bdcff(const char *contents) {
             try {
                 AttribParam ap(*it, ' ');
                 if (!add_highscore(cs.highscore, ap.param, ap.attrib))
-                    gd_message("Invalid highscore: '%s'", *it);
+                    gd_message("Invalid highscore: '%s'", it->str());
             } catch (std::exception &e) {
-                gd_message("Invalid highscore line: '%s'", *it);
+                gd_message("Invalid highscore line: '%s'", it->str());
             }
         }
     }
@@ -760,7 +796,7 @@ CaveSet load_from_bdcff(const char *contents) {
 
     /* PROCESS CAVES */
     /* xxx const iterator cannot be used */
-    for (std::list<BdcffFile::CaveInfo>::iterator it = file.caves.begin(); it != file.caves.end(); ++it) {
+    for (auto it = file.caves.begin(); it != file.caves.end(); ++it) {
         CaveStored cave = default_cave;
 
         cave_process_all_tags(cave, it->properties);
@@ -772,9 +808,9 @@ CaveSet load_from_bdcff(const char *contents) {
                 try {
                     AttribParam ap(*hit, ' ');
                     if (!add_highscore(cave.highscore, ap.param, ap.attrib))
-                        gd_message("Invalid highscore: '%s'", *hit);
+                        gd_message("Invalid highscore: '%s'", hit->str());
                 } catch (std::exception &e) {
-                    gd_message("Invalid highscore line: '%s'", *hit);
+                    gd_message("Invalid highscore line: '%s'", hit->str());
                 }
             }
         }
@@ -808,15 +844,16 @@ CaveSet load_from_bdcff(const char *contents) {
         for (unsigned n = 0; n < 5; ++n)
             levels[n] = true;
         for (auto oit = it->objects.begin(); oit != it->objects.end(); ++oit) {
+            std::string const object = oit->str();
             // process [levels] tags for objects, or process objects.
             // [level] tags are badly designed in bdcff, as they are
             // not really "sections", but properties of objects.
             // yet, they are stored in sections. huge fail.
-            if (*oit == "[/Level]") {
+            if (object == "[/Level]") {
                 for (unsigned n = 0; n < 5; ++n)
                     levels[n] = true;
-            } else if (gd_str_ascii_prefix(*oit, "[Level=")) {
-                std::istringstream is(oit->substr(oit->find('=') + 1));
+            } else if (gd_str_ascii_prefix(object, "[Level=")) {
+                std::istringstream is(object.substr(object.find('=') + 1));
                 for (unsigned n = 0; n < 5; ++n)
                     levels[n] = false;
                 int i;
@@ -833,13 +870,13 @@ CaveSet load_from_bdcff(const char *contents) {
                     is >> c; // read comma
                 }
             } else {
-                auto newobj = CaveObject::create_from_bdcff(*oit);
+                auto newobj = CaveObject::create_from_bdcff(object);
                 if (newobj) {
                     for (unsigned n = 0; n < 5; ++n)
                         newobj->seen_on[n] = levels[n];
                     cave.objects.push_back(std::move(newobj));
                 } else
-                    gd_warning("invalid object specification: %s", *oit);
+                    gd_warning("invalid object specification: %s", object);
             }
         }
 
@@ -855,7 +892,7 @@ CaveSet load_from_bdcff(const char *contents) {
                     AttribParam ap(*lines_it);
                     replay_process_tag(replay, ap.attrib, ap.param);
                 } else
-                    replay_process_tag(replay, "Movements", *lines_it); /* try to interpret it as a bdcff replay */
+                    replay_process_tag(replay, "Movements", lines_it->str()); /* try to interpret it as a bdcff replay */
             }
         }
 
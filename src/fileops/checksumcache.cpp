@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include "cave/caveset.hpp"
+#include "fileops/loadfile.hpp"
+#include "misc/autogfreeptr.hpp"
+#include "misc/printf.hpp"
+#include "settings.hpp"
+
+#include "fileops/checksumcache.hpp"
+
+/*
+ * The checksum of a caveset names its highscore and save state files. Calculating it
+ * renders every cave, which takes a while for big cavesets, so the checksums of the
+ * caveset files are remembered in a text file in the user config directory:
+ *
+ *   GDash checksum cache <version>
+ *   <checksum> <size> <modification time> <absolute path of the caveset file>
+ *   ...
+ *
+ * A checksum is used only if the size and the modification time of the file are
+ * the same as remembered. The checksum depends on the game engine, so the cache
+ * of another version of GDash is not used.
+ *
+ * New checksums are appended to the file; a later line for the same path replaces
+ * the earlier one. When the file has grown to twice the number of entries kept,
+ * it is written again with the most recently added entries only.
+ */
+
+namespace {
+
+/// The number of cavesets remembered.
+const size_t checksum_cache_max = 256;
+
+struct ChecksumCacheEntry {
+    long long size;
+    long long mtime;
+    unsigned checksum;
+    unsigned added;     ///< a serial number; larger for entries added later
+};
+
+typedef std::map<std::string, ChecksumCacheEntry> ChecksumCache;
+
+ChecksumCache checksum_cache;
+bool checksum_cache_loaded = false;
+unsigned checksum_cache_lines = 0;  ///< the number of entries in the file, including the replaced ones
+
+std::string const checksum_cache_header = "GDash checksum cache " PACKAGE_VERSION;
+
+std::string checksum_cache_filename() {
+    AutoGFreePtr<char> path(g_build_path(G_DIR_SEPARATOR_S, gd_user_config_dir.c_str(), "checksums.cache", NULL));
+    return (char *) path;
+}
+
+std::string checksum_cache_line(std::string const &path, ChecksumCacheEntry const &entry) {
+    return Printf("%08x %d %d %s\n", entry.checksum, entry.size, entry.mtime, path);
+}
+
+void checksum_cache_load() {
+    checksum_cache_loaded = true;
+    std::vector<unsigned char> data;
+    try {
+        data = load_file_to_vector(checksum_cache_filename().c_str());
+    } catch (std::exception &) {
+        /* no cache yet, or unreadable; the checksums will be calculated */
+        return;
+    }
+    data.pop_back();    /* the terminating zero added by the loader */
+    std::istringstream is(std::string(data.begin(), data.end()));
+    std::string line;
+    if (!getline(is, line) || line != checksum_cache_header)
+        return;
+    while (getline(is, line)) {
+        ChecksumCacheEntry entry;
+        int pathpos = 0;
+        if (sscanf(line.c_str(), "%x %lld %lld %n", &entry.checksum, &entry.size, &entry.mtime, &pathpos) == 3 && pathpos < int(line.size())) {
+            entry.added = ++checksum_cache_lines;
+            checksum_cache[line.substr(pathpos)] = entry;
+        }
+    }
+}
+
+/// Write the whole file again, with the most recently added entries only.
+void checksum_cache_save() {
+    std::vector<ChecksumCache::const_iterator> entries;
+    for (auto it = checksum_cache.begin(); it != checksum_cache.end(); ++it)
+        entries.push_back(it);
+    std::sort(entries.begin(), entries.end(), [](ChecksumCache::const_iterator a, ChecksumCache::const_iterator b) {
+        return a->second.added > b->second.added;
+    });
+    if (entries.size() > checksum_cache_max)
+        entries.resize(checksum_cache_max);
+
+    ChecksumCache kept;
+    std::string text = checksum_cache_header + "\n";
+    for (size_t i = entries.size(); i-- > 0;) {
+        text += checksum_cache_line(entries[i]->first, entries[i]->second);
+        kept.insert(*entries[i]);
+    }
+    checksum_cache = std::move(kept);
+    checksum_cache_lines = checksum_cache.size();
+    try {
+        save_vector_to_file(checksum_cache_filename().c_str(), std::vector<unsigned char>(text.begin(), text.end()));
+    } catch (std::exception &) {
+        /* not a problem; the checksums are calculated again next time */
+    }
+}
+
+/// Remember a new entry; it is appended to the file, unless the file is to be written again.
+void checksum_cache_add(std::string const &path, ChecksumCacheEntry entry) {
+    entry.added = ++checksum_cache_lines;
+    checksum_cache[path] = entry;
+    if (checksum_cache_lines == 1 || checksum_cache_lines > 2 * checksum_cache_max) {
+        /* there was no usable file, or it has grown too big */
+        checksum_cache_save();
+        return;
+    }
+    std::ofstream os(checksum_cache_filename().c_str(), std::ios::out | std::ios::app | std::ios::binary);
+    os << checksum_cache_line(path, entry);
+}
+
+}
+
+
+/// Get the checksum of a caveset, as CaveSet::checksum(), but remember it for the file
+/// the caveset was loaded from. Loading the highscores and then saving them, or loading
+/// the same file again later needs the checksum to be calculated only once.
+/// Cavesets changed since loading or not loaded from a file are not remembered.
+/// Not thread safe; to be called from the main thread only.
+unsigned gd_caveset_checksum_cached(CaveSet const &caveset) {
+    GStatBuf st;
+    if (caveset.edited || caveset.filename == "" || g_stat(caveset.filename.c_str(), &st) != 0)
+        return caveset.checksum();
+
+    if (!checksum_cache_loaded)
+        checksum_cache_load();
+    auto it = checksum_cache.find(caveset.filename);
+    if (it != checksum_cache.end() && it->second.size == st.st_size && it->second.mtime == st.st_mtime)
+        return it->second.checksum;
+
+    ChecksumCacheEntry entry;
+    entry.size = st.st_size;
+    entry.mtime = st.st_mtime;
+    entry.checksum = caveset.checksum();
+    checksum_cache_add(caveset.filename, entry);
+    return entry.checksum;
+}
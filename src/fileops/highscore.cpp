@@ -30,6 +30,7 @@
 #include "misc/logger.hpp"
 #include "cave/caveset.hpp"
 #include "fileops/highscore.hpp"
+#include "fileops/checksumcache.hpp"
 #include "fileops/bdcffsave.hpp"
 #include "fileops/bdcffload.hpp"
 #include "fileops/bdcffhelper.hpp"
@@ -42,7 +43,7 @@ static std::string filename_for_cave_highscores(CaveSet const & caveset) {
     AutoGFreePtr<char> canon(g_strdup(caveset.name == "" ? "highscore-" : caveset.name.c_str()));
     /* allowed chars in the highscore file name; others are replaced with _ */
     g_strcanon(canon, "abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ", '_');
-    AutoGFreePtr<char> fname(g_strdup_printf("%08x-%s.stat", caveset.checksum(), (char*) canon));
+    AutoGFreePtr<char> fname(g_strdup_printf("%08x-%s.stat", gd_caveset_checksum_cached(caveset), (char*) canon));
     AutoGFreePtr<char> outfile(g_build_path(G_DIR_SEPARATOR_S, gd_user_config_dir.c_str(), (char*) fname, NULL));
     return (char*) outfile;
 }
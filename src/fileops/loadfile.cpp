@@ -111,9 +111,10 @@ CaveSet load_caveset_from_file(const char *filename) {
 /**
  * Load a file to an array of bytes.
  * @param filename The name of the file.
+ * @param max_size Files bigger than this are not loaded. The default is 2MiB, which is plenty for cavesets.
  * @return The file loaded. If impossible to load, throws an exception.
  */
-std::vector<unsigned char> load_file_to_vector(char const *filename) {
+std::vector<unsigned char> load_file_to_vector(char const *filename, int max_size) {
     /* open file */
     std::ifstream is;
     is.open(filename, std::ios::in | std::ios::binary);
@@ -123,8 +124,8 @@ std::vector<unsigned char> load_file_to_vector(char const *filename) {
     is.seekg(0, is.end);
     int filesize = is.tellg();
     is.seekg(0, is.beg);
-    if (filesize > (2 * 1 << 20))
-        throw std::runtime_error(_("File bigger than 2MiB, refusing to load."));
+    if (filesize > max_size)
+        throw std::runtime_error(max_size == LoadFileDefaultMaxSize ? _("File bigger than 2MiB, refusing to load.") : _("File too big, refusing to load."));
     /* read file. the vector will be one bytes bigger, so it can be added a terminating zero char. */
     std::vector<unsigned char> contents(filesize + 1);
     if (!is.read((char *) &contents[0], filesize))
@@ -134,3 +135,24 @@ std::vector<unsigned char> load_file_to_vector(char const *filename) {
 
     return contents;
 }
+
+
+/**
+ * Save an array of bytes to a file. The directory of the file is created, if it does not exist.
+ * @param filename The name of the file.
+ * @param data The contents of the file.
+ * If impossible to save, throws an exception.
+ */
+void save_vector_to_file(char const *filename, std::vector<unsigned char> const &data) {
+    AutoGFreePtr<char> dirname(g_path_get_dirname(filename));
+    g_mkdir_with_parents(dirname, 0700);
+    std::ofstream os;
+    os.open(filename, std::ios::out | std::ios::binary);
+    if (!os)
+        throw std::runtime_error(_("Unable to open file."));
+    if (!os.write((char const *) data.data(), data.size()))
+        throw std::runtime_error(_("Unable to write file."));
+    os.close();
+    if (os.fail())
+        throw std::runtime_error(_("Unable to write file."));
+}
@@ -30,7 +30,11 @@
 
 class CaveSet;
 
-std::vector<unsigned char> load_file_to_vector(char const *filename);
+/// Files bigger than this are not loaded by default.
+enum { LoadFileDefaultMaxSize = 2 * 1 << 20 };
+
+std::vector<unsigned char> load_file_to_vector(char const *filename, int max_size = LoadFileDefaultMaxSize);
+void save_vector_to_file(char const *filename, std::vector<unsigned char> const &data);
 CaveSet load_caveset_from_file(const char *filename);
 CaveSet create_from_buffer(const unsigned char *buffer, int length, char const *filename = "");
 
@@ -104,7 +104,8 @@ GameActivity::GameActivity(App *app, std::unique_ptr<GameControl> thegame)
       gamerenderer(*app->screen, cellrenderer, *app->font_manager, *game),
       exit_game(false),
       show_highscore(false),
-      paused(false)
+      paused(false),
+      state_slot(1)
 {
 }
 
@@ -163,6 +164,34 @@ void GameActivity::keypress_event(KeyCode keycode, int gfxlib_keycode) {
             else
                 gd_message(_("No snapshot saved.")); //app->show_message(_("No snapshot saved."));
             break;
+        case SaveStateKey:
+            if (game->save_state(state_slot))
+                gd_message(_("State saved to slot %d."), state_slot);
+            else
+                gd_message(_("Cannot save state to slot %d."), state_slot);
+            break;
+        case LoadStateKey:
+            if (game->load_state(state_slot))
+                gd_message(_("PLAYING STATE OF SLOT %d"), state_slot);
+            else
+                gd_message(_("No state of this cave in slot %d."), state_slot);
+            break;
+        case NextStateSlotKey:
+            /* slot 0 is the autosave at the start of the cave */
+            state_slot = (state_slot + 1) % GameControl::StateSlots;
+            gd_message(_("State slot %d selected."), state_slot);
+            break;
+        case RewindKey:
+            if (!game->rewind(RewindFrames))
+                gd_message(_("Cannot rewind the game."));
+            break;
+        case SeekReplay25Key:
+        case SeekReplay50Key:
+        case SeekReplay75Key:
+            /* only when viewing a replay */
+            if (game->replay_length() > 0)
+                game->seek_replay(game->replay_length() * (keycode - SeekReplay25Key + 1) / 4);
+            break;
         case CaveVariablesKey:
             gd_sound_off();
             app->show_text_and_do_command(_("Cave Information"), info_and_variables_of_cave(game->original_cave, game->played_cave.get()));
@@ -60,6 +60,13 @@ public:
         RandomColorKey = App::F2,
         TakeSnapshotKey = App::F3,
         RevertToSnapshotKey = App::F4,
+        SaveStateKey = App::F5,
+        LoadStateKey = App::F6,
+        NextStateSlotKey = App::F7,
+        RewindKey = App::BackSpace,
+        SeekReplay25Key = '1',
+        SeekReplay50Key = '2',
+        SeekReplay75Key = '3',
         PauseKey = ' ',
         CaveVariablesKey = App::F8,
     };
@@ -69,6 +76,9 @@ private:
     CellRenderer cellrenderer;
     GameRenderer gamerenderer;
     bool exit_game, show_highscore, paused;
+    int state_slot;     ///< slot for F5 and F6
+    /// Number of cave frames to go back for each press of the rewind key.
+    enum { RewindFrames = 5 };
 };
 
 #endif
@@ -33,6 +33,7 @@
 
 class GdColor;
 class ParticleSet;
+class ParticlePool;
 class Pixbuf;
 class PixmapStorage;
 
@@ -131,7 +132,7 @@ public:
     virtual void set_clip_rect(int x1, int y1, int w, int h) = 0;
     virtual void remove_clip_rect() = 0;
 
-    virtual void draw_particle_set(int dx, int dy, ParticleSet const &ps) {}
+    virtual void draw_particle_set(int dx, int dy, ParticlePool const &pool, ParticleSet const &ps) {}
 
     /** 
      * Tell the graphics system to accept text input;
@@ -203,7 +203,7 @@ std::unique_ptr<Pixmap> GTKScreen::create_pixmap_from_pixbuf(const Pixbuf &pb, b
 }
 
 
-void GTKScreen::draw_particle_set(int dx, int dy, ParticleSet const &ps) {
+void GTKScreen::draw_particle_set(int dx, int dy, ParticlePool const &pool, ParticleSet const &ps) {
     unsigned char r, g, b;
     ps.color.get_rgb(r, g, b);
     cairo_set_source_rgba(cr.get(), r / 255.0, g / 255.0, b / 255.0, ps.life / 1000.0 * ps.opacity);
@@ -213,11 +213,12 @@ void GTKScreen::draw_particle_set(int dx, int dy, ParticleSet const &ps) {
      * dx0, dy0 are the center, and the sides "outgrow". */
     double dxm = dx - size, dx0 = dx + 0.5, dxp = dx + size + 1;
     double dym = dy - size, dy0 = dy + 0.5, dyp = dy + size + 1;
-    for (ParticleSet::const_iterator it = ps.begin(); it != ps.end(); ++it) {
-        cairo_move_to(cr.get(), (int)it->px + dx0, (int)it->py + dym);
-        cairo_line_to(cr.get(), (int)it->px + dxp, (int)it->py + dy0);
-        cairo_line_to(cr.get(), (int)it->px + dx0, (int)it->py + dyp);
-        cairo_line_to(cr.get(), (int)it->px + dxm, (int)it->py + dy0);
+    for (unsigned i = ps.first; i < ps.first + ps.count; ++i) {
+        int px = pool.x(i), py = pool.y(i);
+        cairo_move_to(cr.get(), px + dx0, py + dym);
+        cairo_line_to(cr.get(), px + dxp, py + dy0);
+        cairo_line_to(cr.get(), px + dx0, py + dyp);
+        cairo_line_to(cr.get(), px + dxm, py + dy0);
         cairo_fill(cr.get());
     }
 }
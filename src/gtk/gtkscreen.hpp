@@ -33,6 +33,7 @@
 
 class PixbufFactory;
 class ParticleSet;
+class ParticlePool;
 
 /** Implementation of the Pixmap interface, using GTK+ cairo functions. */
 class GTKPixmap: public Pixmap {
@@ -90,7 +91,7 @@ public:
 
     virtual void fill_rect(int x, int y, int w, int h, const GdColor &c);
     virtual void blit(Pixmap const &src, int dx, int dy) const;
-    virtual void draw_particle_set(int dx, int dy, ParticleSet const &ps);
+    virtual void draw_particle_set(int dx, int dy, ParticlePool const &pool, ParticleSet const &ps);
 
     virtual void set_clip_rect(int x1, int y1, int w, int h);
     virtual void remove_clip_rect();
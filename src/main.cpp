@@ -26,6 +26,7 @@
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <fstream>
+#include <algorithm>
 
 #ifdef HAVE_GTK
 #include <gtk/gtk.h>
@@ -50,6 +51,13 @@
 #include "fileops/highscore.hpp"
 #include "fileops/binaryimport.hpp"
 #include "fileops/exportcrli.hpp"
+#include "cave/replayverify.hpp"
+#include "cave/enginebench.hpp"
+#include "cave/cavesolver.hpp"
+#include "cave/cavedifficulty.hpp"
+#include "cave/goldenhash.hpp"
+#include "cave/engineprofile.hpp"
+#include "cave/helper/caverandom.hpp"
 #include "input/joystick.hpp"
 
 #ifdef HAVE_GTK
@@ -70,6 +78,56 @@
 
 
 
+/// Find the files of cavesets in a directory and its subdirectories, in alphabetical order.
+/// @param dirname The directory to search.
+/// @param filenames The names of the files are appended to this vector.
+static void find_caveset_files(char const *dirname, std::vector<std::string> &filenames) {
+    GDir *dir = g_dir_open(dirname, 0, NULL);
+    if (dir == NULL) {
+        gd_critical(_("Cannot open directory %s"), dirname);
+        return;
+    }
+    std::vector<std::string> names;
+    while (char const *name = g_dir_read_name(dir))
+        if (name[0] != '.')     /* skip hidden files */
+            names.push_back(name);
+    g_dir_close(dir);
+    std::sort(names.begin(), names.end());
+
+    for (auto const &name : names) {
+        char *path = g_build_filename(dirname, name.c_str(), NULL);
+        if (g_file_test(path, G_FILE_TEST_IS_DIR))
+            find_caveset_files(path, filenames);
+        else {
+            for (int i = 0; gd_caveset_extensions[i] != NULL; ++i) {
+                if (g_pattern_match_simple(gd_caveset_extensions[i], name.c_str())) {
+                    filenames.push_back(path);
+                    break;
+                }
+            }
+        }
+        g_free(path);
+    }
+}
+
+
+/// Load all cavesets found in a directory and its subdirectories, in alphabetical order.
+/// Files which cannot be loaded are reported, and skipped.
+/// @param dirname The directory to search.
+/// @param cavesets The cavesets are appended to this vector.
+static void load_cavesets_from_directory(char const *dirname, std::vector<CaveSet> &cavesets) {
+    std::vector<std::string> filenames;
+    find_caveset_files(dirname, filenames);
+    for (auto const &filename : filenames) {
+        try {
+            cavesets.push_back(load_caveset_from_file(filename.c_str()));
+        } catch (std::exception &e) {
+            gd_critical(e.what());
+        }
+    }
+}
+
+
 int main(int argc, char *argv[]) {
     CaveSet caveset;
     int quit = 0;
@@ -82,6 +140,25 @@ int main(int argc, char *argv[]) {
     char *save_cave_name = NULL, *save_gds_name = NULL;
     int exportcrli = 0;
     char *save_cave_name_flat = NULL;
+    gboolean verify_replays = FALSE, verify_segments = FALSE;
+    int threads = 0;
+    int bench_engine_frames = 0;
+    char *bench_format = NULL;
+    int bench_particles = 0;
+    int bench_render_frames = 0;
+    int bench_load_repeats = 0;
+    int bench_batch_games = 0;
+    int difficulty_runs = 0;
+    char *difficulty_policy = NULL, *difficulty_csv = NULL;
+    int solve_cave = 0, solve_level = 1, solve_seed = 0, solve_beam = 300;
+    int check_random_millions = 0;
+    char *golden_record_filename = NULL, *golden_check_filename = NULL;
+    int golden_frames = 500;
+    gboolean golden_cells = FALSE;
+    gboolean full_scan = FALSE;
+#ifdef GD_ENGINE_PROFILE
+    gboolean engine_profile = FALSE;
+#endif
 #ifdef HAVE_GTK
     int save_doc_lang = -1;
 #endif
@@ -101,6 +178,31 @@ int main(int argc, char *argv[]) {
         {"save-gds", 'd', 0, G_OPTION_ARG_FILENAME, &save_gds_name, N_("Save imported binary data to a GDS file. An input file name is required.")},
         {"save-crli", 'x', 0, G_OPTION_ARG_NONE, &exportcrli, N_("Save caveset in CrLi files")},
         {"save-flat", 'f', 0, G_OPTION_ARG_FILENAME, &save_cave_name_flat, N_("Save caveset in flattened format")},
+        {"verify-replays", 0, 0, G_OPTION_ARG_NONE, &verify_replays, N_("Play all replays of all cavesets given, and report the results")},
+        {"verify-segments", 0, 0, G_OPTION_ARG_NONE, &verify_segments, N_("With --verify-replays, also play every replay in segments between the keyframes of its index, and check that the results agree")},
+        {"bench-engine", 0, 0, G_OPTION_ARG_INT, &bench_engine_frames, N_("Measure the speed of the game engine by playing each cave for the given number of frames")},
+        {"bench-format", 0, 0, G_OPTION_ARG_STRING, &bench_format, N_("Output format of the engine benchmark: text, csv or json")},
+        {"solve", 0, 0, G_OPTION_ARG_INT, &solve_cave, N_("Search for a solution of the given cave (1 is the first one), and add it to the caveset as a replay")},
+        {"solve-level", 0, 0, G_OPTION_ARG_INT, &solve_level, N_("Level to solve the cave on, default 1")},
+        {"solve-seed", 0, 0, G_OPTION_ARG_INT, &solve_seed, N_("Random seed to render the cave to solve with, default 0")},
+        {"solve-beam", 0, 0, G_OPTION_ARG_INT, &solve_beam, N_("Number of states the solver keeps in each frame, default 300")},
+        {"bench-particles", 0, 0, G_OPTION_ARG_INT, &bench_particles, N_("Measure the speed of the particle effects by spawning the given number of explosions")},
+        {"bench-render", 0, 0, G_OPTION_ARG_INT, &bench_render_frames, N_("Measure the cost of rendering a frame against the size of the cave, for the given number of frames")},
+        {"bench-load", 0, 0, G_OPTION_ARG_INT, &bench_load_repeats, N_("Measure the speed of loading all cavesets given, by parsing each of them the given number of times")},
+        {"bench-batch", 0, 0, G_OPTION_ARG_INT, &bench_batch_games, N_("Measure the speed of simulating many games by playing each cave the given number of times, one by one and as a batch")},
+        {"difficulty", 0, 0, G_OPTION_ARG_INT, &difficulty_runs, N_("Play each cave on each level the given number of times with simulated players, and report how they fared")},
+        {"difficulty-policy", 0, 0, G_OPTION_ARG_STRING, &difficulty_policy, N_("How the simulated players move: greedy (the default) or random")},
+        {"difficulty-csv", 0, 0, G_OPTION_ARG_FILENAME, &difficulty_csv, N_("Save every playthrough of the difficulty analysis to a CSV file")},
+        {"golden-record", 0, 0, G_OPTION_ARG_FILENAME, &golden_record_filename, N_("Play all caves and replays, and save the hash of every frame to a golden file")},
+        {"golden-check", 0, 0, G_OPTION_ARG_FILENAME, &golden_check_filename, N_("Play all caves and replays, and compare the hash of every frame to a golden file")},
+        {"golden-frames", 0, 0, G_OPTION_ARG_INT, &golden_frames, N_("Number of frames to play caves with scripted movements for the golden file, default 500")},
+        {"golden-cells", 0, 0, G_OPTION_ARG_NONE, &golden_cells, N_("Also save the changed cells of every frame to the golden file, to report where a cave diverges")},
+        {"full-scan", 0, 0, G_OPTION_ARG_NONE, &full_scan, N_("With --verify-replays and the golden file options, scan every cell of the caves like the game does, instead of skipping the idle ones")},
+#ifdef GD_ENGINE_PROFILE
+        {"engine-profile", 0, 0, G_OPTION_ARG_NONE, &engine_profile, N_("Print where the game engine spent its time during the batch tasks")},
+#endif
+        {"check-random", 0, 0, G_OPTION_ARG_INT, &check_random_millions, N_("Check that the random generator of the caves gives the same numbers as GLib, drawing the given number of millions")},
+        {"threads", 0, 0, G_OPTION_ARG_INT, &threads, N_("Number of threads to use for batch tasks, 0 for all processors")},
 #ifdef HAVE_GTK
         {"save-docs", 0, 0, G_OPTION_ARG_INT, &save_doc_lang, N_("Save documentation in HTML, in the given language identified by an integer.")},
 #endif
@@ -183,8 +285,11 @@ int main(int argc, char *argv[]) {
     /* if remaining arguments, they are filenames */
     try {
         if (gd_param_cavenames && gd_param_cavenames[0]) {
-            caveset = load_caveset_from_file(gd_param_cavenames[0]);
-            load_highscore(caveset);
+            /* directories are only used by the batch tasks below */
+            if (!g_file_test(gd_param_cavenames[0], G_FILE_TEST_IS_DIR)) {
+                caveset = load_caveset_from_file(gd_param_cavenames[0]);
+                load_highscore(caveset);
+            }
         } else {
             /* export-fork: load BD1 by default */
             try {
@@ -241,6 +346,36 @@ int main(int argc, char *argv[]) {
     }
 #endif
 
+    /* search for a solution of a cave. done before saving, so the replay found can be saved. */
+    int solve_failed = 0;
+    if (solve_cave > 0) {
+        if (solve_cave > int(caveset.caves.size()) || solve_level < 1 || solve_level > 5) {
+            gd_critical(_("No cave %d on level %d to solve"), solve_cave, solve_level);
+            solve_failed++;
+        } else {
+            CaveStored &cave = caveset.caves[solve_cave - 1];
+            SolverOptions options;
+            options.beam_width = std::max(solve_beam, 1);
+            options.threads = threads > 0 ? threads : 0;
+            options.progress = [](int frames, int states, int diamonds) {
+                if (frames % 500 == 0)
+                    g_print("%s", Printf("frame %d: %d states, best has %d diamonds\n", frames, states, diamonds).c_str());
+            };
+            SolverResult result = gd_cave_solve(cave, solve_level - 1, solve_seed, options);
+            g_print("%s", Printf("%s, level %d: %s after %d frames searched; %d states, %d duplicates\n",
+                                 cave.name, solve_level, result.solved ? "solved" : "no solution found",
+                                 result.frames, result.states, result.duplicates).c_str());
+            g_print("%s", Printf("%.2f s wall time; %.2f s cpu copying caves, %.2f s cpu iterating\n",
+                                 result.wall_time, result.copy_seconds, result.iterate_seconds).c_str());
+            if (result.solved) {
+                g_print("%s", Printf("%d movements, score %d, %d s: %s\n", result.replay.length(), result.replay.score,
+                                     result.replay.duration, result.replay.movements_to_bdcff()).c_str());
+                cave.replays.push_back(result.replay);
+            } else
+                solve_failed++;
+        }
+    }
+
     if (save_cave_name)
         caveset.save_to_file(save_cave_name);
 
@@ -267,13 +402,105 @@ int main(int argc, char *argv[]) {
                CaveStored cave = caveset.caves.at(n);
                int edit_level = 0;
                CaveRendered rendered(cave, edit_level, 0);   /* render cave at specified level to obtain map. seed=0 */
-               cave.map = rendered.map;
+               cave.map = rendered.map.to_cave_map();
                cave.objects.clear();
                caveset.caves.at(n) = cave;
        }
        caveset.save_to_file(save_cave_name_flat);
    }
 
+    int verify_failed = solve_failed;
+    if (check_random_millions > 0 && !gd_random_check_glib(check_random_millions * 1000000ul))
+        verify_failed++;
+    if (bench_particles > 0)
+        gd_benchmark_particles(bench_particles);
+    if (bench_render_frames > 0)
+        gd_benchmark_render(bench_render_frames);
+    if (bench_load_repeats > 0) {
+        std::vector<std::string> filenames;
+        for (int i = 0; gd_param_cavenames && gd_param_cavenames[i] != NULL; ++i) {
+            if (g_file_test(gd_param_cavenames[i], G_FILE_TEST_IS_DIR))
+                find_caveset_files(gd_param_cavenames[i], filenames);
+            else
+                filenames.push_back(gd_param_cavenames[i]);
+        }
+        gd_benchmark_loader(filenames, bench_load_repeats);
+    }
+
+    /* batch tasks which work on all cavesets given on the command line */
+    if (verify_replays || bench_engine_frames > 0 || golden_record_filename || golden_check_filename || difficulty_runs > 0 || bench_batch_games > 0) {
+        std::vector<CaveSet> cavesets;
+        if (gd_param_cavenames && gd_param_cavenames[0]) {
+            for (int i = 0; gd_param_cavenames[i] != NULL; ++i) {
+                if (g_file_test(gd_param_cavenames[i], G_FILE_TEST_IS_DIR))
+                    load_cavesets_from_directory(gd_param_cavenames[i], cavesets);
+                else if (i == 0)
+                    cavesets.push_back(caveset);
+                else {
+                    try {
+                        cavesets.push_back(load_caveset_from_file(gd_param_cavenames[i]));
+                    } catch (std::exception &e) {
+                        gd_critical(e.what());
+                    }
+                }
+            }
+        } else
+            cavesets.push_back(caveset);
+        if (verify_replays)
+            verify_failed += gd_verify_replays(cavesets, threads > 0 ? threads : 0, verify_segments, full_scan);
+        if (golden_check_filename) {
+            std::vector<unsigned char> data;
+            std::vector<GoldenRun> golden;
+            bool loaded = false;
+            try {
+                /* with the changed cells recorded, golden files can be a lot bigger than cavesets */
+                data = load_file_to_vector(golden_check_filename, 1 << 30);
+                data.pop_back();    /* the terminating zero added by the loader */
+                loaded = gd_golden_load(data, golden);
+            } catch (std::exception &e) {
+                gd_critical("%s: %s", golden_check_filename, e.what());
+            }
+            if (!loaded) {
+                gd_critical(_("Cannot load golden file %s"), golden_check_filename);
+                verify_failed++;
+            } else {
+                bool cells = std::any_of(golden.begin(), golden.end(), [](GoldenRun const &run) {
+                    return !run.changes.empty();
+                });
+                std::vector<GoldenRun> runs = gd_golden_play(cavesets, golden_frames, cells, threads > 0 ? threads : 0, full_scan);
+                verify_failed += gd_golden_compare(golden, runs);
+            }
+        }
+        if (golden_record_filename) {
+            std::vector<GoldenRun> runs = gd_golden_play(cavesets, golden_frames, golden_cells, threads > 0 ? threads : 0, full_scan);
+            try {
+                save_vector_to_file(golden_record_filename, gd_golden_save(runs));
+            } catch (std::exception &e) {
+                gd_critical("%s: %s", golden_record_filename, e.what());
+                gd_critical(_("Cannot save golden file %s"), golden_record_filename);
+                verify_failed++;
+            }
+        }
+        if (bench_engine_frames > 0) {
+            GdBenchFormat format = GD_BENCH_FORMAT_TEXT;
+            if (bench_format != NULL && !gd_bench_format_from_string(bench_format, format))
+                gd_warning(_("Invalid benchmark output format: %s"), bench_format);
+            gd_benchmark_engine(cavesets, bench_engine_frames, format);
+        }
+        if (bench_batch_games > 0 && !gd_benchmark_batch(cavesets, bench_batch_games, threads > 0 ? threads : 0))
+            verify_failed++;
+        if (difficulty_runs > 0) {
+            GdPlayPolicy policy = GD_PLAY_GREEDY;
+            if (difficulty_policy != NULL && !gd_play_policy_from_string(difficulty_policy, policy))
+                gd_warning(_("Invalid player policy: %s"), difficulty_policy);
+            gd_difficulty_report(cavesets, difficulty_runs, policy, threads > 0 ? threads : 0, difficulty_csv);
+        }
+#ifdef GD_ENGINE_PROFILE
+        if (engine_profile)
+            g_print("%s", gd_engine_profile_total().report().c_str());
+#endif
+    }
+
 #ifdef HAVE_GTK
     gd_register_stock_icons();
 
@@ -309,7 +536,7 @@ int main(int argc, char *argv[]) {
     /* if batch mode, quit now */
     if (quit) {
         global_logger.clear();
-        return 0;
+        return verify_failed > 0 ? 1 : 0;
     }
 #ifdef HAVE_GTK
     if (force_quit_no_gtk) {
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef BYTESTREAM_HPP_INCLUDED
+#define BYTESTREAM_HPP_INCLUDED
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Helpers for the binary files of the game: save states, replay indices,
+ * rewind buffers and golden files. Numbers are stored in little-endian byte
+ * order, independently of the machine, or as 7-bit varints (the low seven
+ * bits first, the high bit set on every byte but the last).
+ *
+ * The get functions read at pos, and advance it. They return false, and
+ * leave the value undefined, if there is not enough data.
+ */
+
+/// Append a 16-bit number.
+inline void gd_put16(std::vector<unsigned char> &data, unsigned v) {
+    data.push_back(v & 0xff);
+    data.push_back((v >> 8) & 0xff);
+}
+
+/// Append a 32-bit number.
+inline void gd_put32(std::vector<unsigned char> &data, uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+        data.push_back((v >> (i * 8)) & 0xff);
+}
+
+/// Append a number as a varint.
+inline void gd_put_varint(std::vector<unsigned char> &data, size_t v) {
+    while (v >= 0x80) {
+        data.push_back((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    data.push_back(v);
+}
+
+/// Read a 16-bit number.
+inline bool gd_get16(std::vector<unsigned char> const &data, size_t &pos, unsigned &v) {
+    if (data.size() - pos < 2)
+        return false;
+    v = data[pos] | data[pos + 1] << 8;
+    pos += 2;
+    return true;
+}
+
+/// Read a 32-bit number.
+inline bool gd_get32(std::vector<unsigned char> const &data, size_t &pos, uint32_t &v) {
+    if (data.size() - pos < 4)
+        return false;
+    v = data[pos] | data[pos + 1] << 8 | data[pos + 2] << 16 | uint32_t(data[pos + 3]) << 24;
+    pos += 4;
+    return true;
+}
+
+/// Read a varint.
+inline bool gd_get_varint(std::vector<unsigned char> const &data, size_t &pos, size_t &v) {
+    v = 0;
+    for (unsigned shift = 0; pos < data.size() && shift < sizeof(size_t) * 8; shift += 7) {
+        unsigned char byte = data[pos++];
+        v |= size_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+#endif
@@ -194,6 +194,11 @@ helpdata const gamehelp[] = {
     { NULL, NULL, "F2", O_NONE, N_("Random colors") },
     { NULL, NULL, "F3", O_NONE, N_("Take snapshot") },
     { NULL, NULL, "F4", O_NONE, N_("Revert to snapshot") },
+    { NULL, NULL, "F5", O_NONE, N_("Save state to slot") },
+    { NULL, NULL, "F6", O_NONE, N_("Load state from slot") },
+    { NULL, NULL, "F7", O_NONE, N_("Select next slot (0 is saved at cave start)") },
+    { NULL, NULL, "Backspace", O_NONE, N_("Rewind (hold to go back further)") },
+    { NULL, NULL, "1, 2, 3", O_NONE, N_("Jump to 25%, 50%, 75% of replay") },
     { NULL, NULL, "F8", O_NONE, N_("Cave variables (for testing)") },
     { NULL, NULL, "F9", O_NONE, N_("Sound volume") },
 #ifdef HAVE_GTK
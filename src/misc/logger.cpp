@@ -30,6 +30,7 @@
 #include "misc/logger.hpp"
 
 std::vector<Logger *> Logger::loggers;
+std::mutex Logger::mutex;
 
 static char severity_char(ErrorMessage::Severity sev) {
     switch (sev) {
@@ -78,6 +79,7 @@ static void log_func(const gchar *log_domain, GLogLevelFlags log_level, const gc
 Logger::Logger(bool ignore_)
     :
     ignore(ignore_) {
+    std::lock_guard<std::mutex> lock(mutex);
     /* if this is the first logger created */
     if (loggers.empty())
         g_log_set_default_handler(log_func, NULL);
@@ -93,6 +95,7 @@ Logger::~Logger() {
         for (Container::const_iterator it = messages.begin(); it != messages.end(); ++it)
             std::cerr << "  " << *it << std::endl;
     }
+    std::lock_guard<std::mutex> lock(mutex);
     assert(loggers.back() == this);
     loggers.pop_back();
     if (loggers.empty())
@@ -101,6 +104,7 @@ Logger::~Logger() {
 
 /// Clears the logger to empty. (No messages.)
 void Logger::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
     messages.clear();
 }
 
@@ -111,6 +115,7 @@ bool Logger::empty() const {
 }
 
 void Logger::set_context(std::string new_context) {
+    std::lock_guard<std::mutex> lock(mutex);
     context = std::move(new_context);
 }
 
@@ -142,6 +147,12 @@ std::string Logger::get_messages_in_one_string() const {
 /// Log a new message.
 /// If a context is set, it will also be noted.
 void Logger::log(ErrorMessage::Severity sev, std::string const &message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    append(sev, message);
+}
+
+/// Store a new message; the caller must hold the mutex.
+void Logger::append(ErrorMessage::Severity sev, std::string const &message) {
     // if ignoring messages, do nothing
     if (ignore)
         return;
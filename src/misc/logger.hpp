@@ -33,6 +33,7 @@
 #include <utility>
 #include <cassert>
 #include <iostream>
+#include <mutex>
 
 /// A simple class to store an error message.
 /// Each message has a string and a severity level.
@@ -93,6 +94,11 @@ struct ErrorMessage {
  * }             // logger is deleted here
  * @endcode
  *
+ * Messages can also be logged from worker threads, eg. the jobs of
+ * gd_parallel_for(). A mutex protects the list of loggers and the messages,
+ * so these messages go to the logger which was created last, as usual.
+ * Loggers themselves should be created and destroyed on the main thread.
+ *
  * It is up to the caller to create the logger objects.
  * It is recommended to create a "global" logger object int the
  * main() function, which will receive all log messages, when
@@ -111,6 +117,7 @@ struct ErrorMessage {
 class Logger {
 private:
     static std::vector<Logger *> loggers;
+    static std::mutex mutex;    ///< protects loggers, and the messages and the context of the loggers
 public:
     typedef std::vector<ErrorMessage> Container;
     typedef Container::const_iterator ConstIterator;
@@ -123,6 +130,7 @@ private:
 
     void set_context(std::string new_context = std::string());
     std::string const &get_context() const;
+    void append(ErrorMessage::Severity sev, std::string const &message);
 
 public:
     Logger(bool ignore_ = false);
@@ -149,17 +157,15 @@ public:
 
 template <typename ... ARGS>
 void log(ErrorMessage::Severity sev, std::string const &message, ARGS const & ... args) {
+    std::string const formatted = sizeof...(args) == 0 ? message : std::string(Printf(message, args...));
+
+    std::lock_guard<std::mutex> lock(Logger::mutex);
     /* check if at least one logger exists */
     if (Logger::loggers.empty()) {
-        std::cerr << message;
+        std::cerr << formatted;
         return;
     }
-    
-    if (sizeof...(args) == 0) {
-        Logger::get_active_logger().log(sev, message);
-    } else {
-        Logger::get_active_logger().log(sev, Printf(message, args...));
-    }
+    Logger::loggers.back()->append(sev, formatted);
 }
 
 
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2007-2018, GDash Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ * CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef PARALLEL_HPP_INCLUDED
+#define PARALLEL_HPP_INCLUDED
+
+#include "config.h"
+
+#include <functional>
+
+/// @brief Number of worker threads to use, if the user did not specify.
+/// This is the number of processors, but at least one.
+unsigned gd_parallel_default_threads();
+
+/// @brief Run a job for all indices 0..count-1 on a pool of worker threads.
+/// Indices are handed out to the workers one by one, so jobs of very
+/// different length are balanced well. The function returns when all
+/// jobs are finished. The job function must be thread safe; it
+/// may log via gd_warning() etc., the messages go to the active logger.
+/// @param count The number of jobs.
+/// @param threads The number of threads to start; 0 means gd_parallel_default_threads().
+/// @param job The function to call with the index of the job.
+void gd_parallel_for(unsigned count, unsigned threads, std::function<void(unsigned)> const &job);
+
+#endif
@@ -169,6 +169,19 @@ bool gd_str_ascii_prefix(const std::string &str, const std::string &prefix) {
 }
 
 
+std::string gd_csv_quote(std::string const &s) {
+    if (s.find_first_of(",\"\n\r") == std::string::npos)
+        return s;
+    std::string quoted = "\"";
+    for (char c : s) {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+
 std::vector<std::string> gd_wrap_text(const char *input, int width) {
     std::vector<std::string> retlines;
 
@@ -66,4 +66,7 @@ bool gd_str_equal(const char *a, const char *b);
 
 bool gd_str_ascii_prefix(const std::string &str, const std::string &prefix);
 
+/// quote a string for a csv file, if it contains a comma, a quote or a newline
+std::string gd_csv_quote(std::string const &s);
+
 #endif
@@ -245,7 +245,7 @@ static void filledDiamondColor(SDL_Surface *dst, Sint16 xc, Sint16 yc, Sint16 r,
 }
 
 
-void SDLAbstractScreen::draw_particle_set(int dx, int dy, ParticleSet const &ps) {
+void SDLAbstractScreen::draw_particle_set(int dx, int dy, ParticlePool const &pool, ParticleSet const &ps) {
     unsigned char r, g, b;
     ps.color.get_rgb(r, g, b);
     Uint8 a = ps.life / 1000.0 * ps.opacity * 255;
@@ -255,8 +255,8 @@ void SDLAbstractScreen::draw_particle_set(int dx, int dy, ParticleSet const &ps)
         if (SDL_LockSurface(surface.get()) < 0)
             return;
     bool software_pal_emulation = get_pal_emulation();
-    for (ParticleSet::const_iterator it = ps.begin(); it != ps.end(); ++it) {
-        filledDiamondColor(surface.get(), dx + it->px, dy + it->py, size, color, software_pal_emulation);
+    for (unsigned i = ps.first; i < ps.first + ps.count; ++i) {
+        filledDiamondColor(surface.get(), dx + pool.x(i), dy + pool.y(i), size, color, software_pal_emulation);
     }
     if (SDL_MUSTLOCK(surface.get()))
         SDL_UnlockSurface(surface.get());
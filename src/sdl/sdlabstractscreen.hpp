@@ -33,6 +33,7 @@
 #include "misc/deleter.hpp"
 
 class ParticleSet;
+class ParticlePool;
 class GdColor;
 class PixbufFactory;
 
@@ -61,7 +62,7 @@ public:
     virtual void blit(Pixmap const &src, int dx, int dy) const override;
     virtual void set_clip_rect(int x1, int y1, int w, int h) override;
     virtual void remove_clip_rect() override;
-    virtual void draw_particle_set(int dx, int dy, ParticleSet const &ps) override;
+    virtual void draw_particle_set(int dx, int dy, ParticlePool const &pool, ParticleSet const &ps) override;
 };
 
 #endif
@@ -109,6 +109,7 @@ bool gd_show_story = true;
 bool gd_show_name_of_game = true;
 int gd_status_bar_colors = GD_STATUS_BAR_ORIGINAL;
 bool gd_alternate_vertical_animation = true;
+int gd_rewind_buffer_size = 16;  /* megabytes */
 
 /* palette settings */
 int gd_c64_palette = 0;
@@ -236,6 +237,7 @@ Setting *gd_get_game_settings_array() {
         { TypeBoolean, N_("Show story"), &gd_show_story, false, NULL, N_("If the cave has a story, it will be shown when the cave is first started.") },
         { TypeBoolean, N_("Game name at uncover"), &gd_show_name_of_game, false, NULL, N_("Show the name of the game when uncovering a cave.") },
         { TypeBoolean, N_("No invisible outbox"), &gd_no_invisible_outbox, false, NULL, N_("Show invisible outboxes as visible (blinking) ones.") },
+        { TypeInteger, N_("Rewind memory (MB)"), &gd_rewind_buffer_size, false, NULL, N_("Memory used to remember the last moves of the game, so it can be rewound. Zero disables rewinding."), 0, 256 },
 
         { TypePage, N_("Theme and colors") },
         { TypeTheme,   N_("Theme"), NULL, false, NULL, N_("Graphics theme used inside the game."), 0, 0, NULL },
@@ -481,6 +483,7 @@ void gd_settings_init() {
     settings_bools["show_name_of_game"] = &gd_show_name_of_game;
     settings_integers["pal_emu_scanline_shade"] = &gd_pal_emu_scanline_shade;
     settings_integers["status_bar_colors"] = &gd_status_bar_colors;
+    settings_integers["rewind_buffer_size"] = &gd_rewind_buffer_size;
     settings_integers["c64_palette"] = &gd_c64_palette;
     settings_integers["c64dtv_palette"] = &gd_c64dtv_palette;
     settings_integers["atari_palette"] = &gd_atari_palette;
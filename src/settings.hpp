@@ -49,6 +49,7 @@ extern bool gd_show_story;
 extern bool gd_show_name_of_game;
 extern int gd_status_bar_colors;
 extern bool gd_alternate_vertical_animation;
+extern int gd_rewind_buffer_size;
 
 /* palette settings */
 extern int gd_c64_palette;